@@ -0,0 +1,547 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+//
+// Benchmarks of hll.h
+//
+// Prints one comma separated record per line:
+//
+//   benchmark,precision,n,metric,value
+//
+// Lines starting with # are comments. Pass the names of the suites
+// to run, or none to run them all:
+//
+//   - add: ns per element of hll_add, hll_add_many,
+//     hll_add_many_fixed and hll_add_hashes in a dense hll, of
+//     hll_add built with HLL_HASH_INLINE in bench_inline.c, and of
+//     the add function generated by HLL_SPECIALIZE at precision
+//     BENCH_SPECIALIZED_PRECISION
+//   - count: ns per hll_count of a dense hll
+//   - merge: ns per hll_merge and GB/s of source registers
+//   - parallel: ns per element of hll_add_many_parallel and ns per
+//     hll of hll_count_many and hll_count_many_pool with 1 to
+//     BENCH_THREADS threads, when built with HLL_THREADS
+//   - error: mean and root mean square relative error of the
+//     estimators, over BENCH_RUNS hlls for each cardinality
+//
+// Cardinalities up to BENCH_INSERT_MAX are measured inserting random
+// hashes. Bigger ones, up to 10^10, are simulated drawing each dense
+// register from its distribution, since inserting them would take
+// hours.
+//
+
+#define _POSIX_C_SOURCE 200112L
+
+#define HLL_IMPLEMENTATION
+#include "hll.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Number of hlls averaged for each point of the error curves
+#ifndef BENCH_RUNS
+  #define BENCH_RUNS 20
+#endif
+
+// Number of elements inserted by the add suite
+#ifndef BENCH_ADD_LEN
+  #define BENCH_ADD_LEN (1u << 20)
+#endif
+
+// Highest cardinality of the error curves measured with insertions
+#ifndef BENCH_INSERT_MAX
+  #define BENCH_INSERT_MAX 1000000
+#endif
+
+// Highest number of threads of the parallel suite
+#ifndef BENCH_THREADS
+  #define BENCH_THREADS 8
+#endif
+
+// Each timed benchmark is repeated and the fastest run is reported
+#define BENCH_REPEAT 3
+
+// Precision of the specialized hll of the add suite
+#define BENCH_SPECIALIZED_PRECISION 14
+
+HLL_SPECIALIZE(bench_specialized, BENCH_SPECIALIZED_PRECISION,
+               HLL_HASH_FUNC, HLL_HASH_ID)
+
+// See bench_inline.c
+long long bench_inline_add(unsigned int precision,
+                           char **elements,
+                           const unsigned int *lengths,
+                           unsigned int len);
+
+static volatile long long bench_sink;
+
+static uint64_t bench_state = 0x9e3779b97f4a7c15ULL;
+
+// splitmix64 pseudo random number generator
+static uint64_t bench_random(void)
+{
+  uint64_t z = (bench_state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// Uniform double in (0, 1]
+static double bench_uniform(void)
+{
+  return ((bench_random() >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+static double bench_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench_record(const char *benchmark,
+                         unsigned int precision,
+                         unsigned long long n,
+                         const char *metric,
+                         double value)
+{
+  printf("%s,%u,%llu,%s,%.6g\n", benchmark, precision, n, metric, value);
+}
+
+static void bench_check(hll_error err, const char *what)
+{
+  if (err >= 0)
+    return;
+  fprintf(stderr, "%s: %s\n", what, hll_error_string(err));
+  exit(1);
+}
+
+static void bench_dense(hll_t *hll, unsigned int precision)
+{
+  bench_check(hll_init(hll,
+                       .precision = precision,
+                       .register_bits = 8,
+                       .representation = HLL_REPRESENTATION_DENSE),
+              "hll_init");
+}
+
+enum { BENCH_ADD, BENCH_ADD_MANY, BENCH_ADD_MANY_FIXED, BENCH_ADD_HASHES };
+
+static void bench_add(void)
+{
+  static const char *names[] = {
+    "add", "add_many", "add_many_fixed", "add_hashes",
+  };
+  const unsigned int len = BENCH_ADD_LEN;
+  uint64_t *keys = malloc(len * sizeof(*keys));
+  char **elements = malloc(len * sizeof(*elements));
+  unsigned int *lengths = malloc(len * sizeof(*lengths));
+  hll_hash_t *hashes = malloc(len * sizeof(*hashes));
+  if (keys == NULL || elements == NULL || lengths == NULL || hashes == NULL)
+  {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  for (unsigned int i = 0; i < len; ++i)
+  {
+    keys[i] = bench_random();
+    elements[i] = (char*)&keys[i];
+    lengths[i] = sizeof(keys[i]);
+    hashes[i] = hll_hash_bytes(&keys[i], sizeof(keys[i]));
+  }
+
+  for (unsigned int precision = HLL_PRECISION_MIN;
+       precision <= HLL_PRECISION_MAX; ++precision)
+  {
+    for (int api = BENCH_ADD; api <= BENCH_ADD_HASHES; ++api)
+    {
+      double best = 0;
+      for (int repeat = 0; repeat < BENCH_REPEAT; ++repeat)
+      {
+        hll_t hll;
+        bench_dense(&hll, precision);
+        double start = bench_now();
+        switch (api)
+        {
+        case BENCH_ADD:
+          for (unsigned int i = 0; i < len; ++i)
+            bench_check(hll_add(&hll, elements[i], lengths[i]), "hll_add");
+          break;
+        case BENCH_ADD_MANY:
+          bench_check(hll_add_many(&hll, elements, lengths, len),
+                      "hll_add_many");
+          break;
+        case BENCH_ADD_MANY_FIXED:
+          bench_check(hll_add_many_fixed(&hll, elements,
+                                         sizeof(keys[0]), len),
+                      "hll_add_many_fixed");
+          break;
+        case BENCH_ADD_HASHES:
+          bench_check(hll_add_hashes(&hll, hashes, len), "hll_add_hashes");
+          break;
+        }
+        double elapsed = bench_now() - start;
+        if (repeat == 0 || elapsed < best)
+          best = elapsed;
+        bench_sink += hll_count(&hll);
+        hll_destroy(&hll);
+      }
+      bench_record(names[api], precision, len, "ns_per_element",
+                   best / len);
+    }
+
+    // The add loop with the hash function called directly
+    double best = 0;
+    for (int repeat = 0; repeat < BENCH_REPEAT; ++repeat)
+    {
+      double start = bench_now();
+      long long count = bench_inline_add(precision, elements, lengths, len);
+      double elapsed = bench_now() - start;
+      if (count < 0)
+        bench_check((hll_error)count, "bench_inline_add");
+      if (repeat == 0 || elapsed < best)
+        best = elapsed;
+      bench_sink += count;
+    }
+    bench_record("add_inline", precision, len, "ns_per_element", best / len);
+  }
+
+  // Same elements as the add benchmark at this precision
+  double best = 0;
+  for (int repeat = 0; repeat < BENCH_REPEAT; ++repeat)
+  {
+    hll_t hll;
+    bench_check(bench_specialized_init(&hll), "bench_specialized_init");
+    double start = bench_now();
+    for (unsigned int i = 0; i < len; ++i)
+      bench_check(bench_specialized_add(&hll, elements[i], lengths[i]),
+                  "bench_specialized_add");
+    double elapsed = bench_now() - start;
+    if (repeat == 0 || elapsed < best)
+      best = elapsed;
+    bench_sink += bench_specialized_count(&hll);
+    hll_destroy(&hll);
+  }
+  bench_record("add_specialized", BENCH_SPECIALIZED_PRECISION, len,
+               "ns_per_element", best / len);
+
+  free(keys);
+  free(elements);
+  free(lengths);
+  free(hashes);
+}
+
+static void bench_count(void)
+{
+  for (unsigned int precision = HLL_PRECISION_MIN;
+       precision <= HLL_PRECISION_MAX; ++precision)
+  {
+    hll_t hll;
+    bench_dense(&hll, precision);
+    const unsigned long long n = 10ull << precision;
+    for (unsigned long long i = 0; i < n; ++i)
+      hll_add_hash(&hll, bench_random());
+
+    const unsigned int calls = (1u << 24) >> precision;
+    double best = 0;
+    for (int repeat = 0; repeat < BENCH_REPEAT; ++repeat)
+    {
+      double start = bench_now();
+      for (unsigned int i = 0; i < calls; ++i)
+        bench_sink += hll_count(&hll);
+      double elapsed = bench_now() - start;
+      if (repeat == 0 || elapsed < best)
+        best = elapsed;
+    }
+    bench_record("count", precision, n, "ns_per_call", best / calls);
+    hll_destroy(&hll);
+  }
+}
+
+static void bench_merge(void)
+{
+  for (unsigned int precision = HLL_PRECISION_MIN;
+       precision <= HLL_PRECISION_MAX; ++precision)
+  {
+    hll_t dest, src;
+    bench_dense(&dest, precision);
+    bench_dense(&src, precision);
+    const unsigned long long n = 10ull << precision;
+    for (unsigned long long i = 0; i < n; ++i)
+    {
+      hll_add_hash(&dest, bench_random());
+      hll_add_hash(&src, bench_random());
+    }
+
+    const size_t size = HLL_REGISTERS_SIZE(precision, 8);
+    const unsigned int merges = (1u << 26) / size;
+    double best = 0;
+    for (int repeat = 0; repeat < BENCH_REPEAT; ++repeat)
+    {
+      double start = bench_now();
+      for (unsigned int i = 0; i < merges; ++i)
+        bench_check(hll_merge(&dest, &src), "hll_merge");
+      double elapsed = bench_now() - start;
+      if (repeat == 0 || elapsed < best)
+        best = elapsed;
+    }
+    bench_sink += hll_count(&dest);
+    bench_record("merge", precision, n, "ns_per_merge", best / merges);
+    bench_record("merge", precision, n, "gb_per_s",
+                 (double)size * merges / best);
+    hll_destroy(&dest);
+    hll_destroy(&src);
+  }
+}
+
+#ifdef HLL_THREADS
+static void bench_parallel(void)
+{
+  const unsigned int len = 4 * BENCH_ADD_LEN;
+  uint64_t *keys = malloc(len * sizeof(*keys));
+  char **elements = malloc(len * sizeof(*elements));
+  unsigned int *lengths = malloc(len * sizeof(*lengths));
+  if (keys == NULL || elements == NULL || lengths == NULL)
+  {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  for (unsigned int i = 0; i < len; ++i)
+  {
+    keys[i] = bench_random();
+    elements[i] = (char*)&keys[i];
+    lengths[i] = sizeof(keys[i]);
+  }
+
+  const unsigned int precision = 14;
+  for (unsigned int threads = 1; threads <= BENCH_THREADS; threads *= 2)
+  {
+    double best = 0;
+    for (int repeat = 0; repeat < BENCH_REPEAT; ++repeat)
+    {
+      hll_t hll;
+      bench_dense(&hll, precision);
+      double start = bench_now();
+      bench_check(hll_add_many_parallel(&hll, elements, lengths, len,
+                                        threads),
+                  "hll_add_many_parallel");
+      double elapsed = bench_now() - start;
+      if (repeat == 0 || elapsed < best)
+        best = elapsed;
+      bench_sink += hll_count(&hll);
+      hll_destroy(&hll);
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "add_parallel_%u", threads);
+    bench_record(name, precision, len, "ns_per_element", best / len);
+  }
+
+  free(keys);
+  free(elements);
+  free(lengths);
+
+  // Many small sketches, as in the groups of a group-by query
+  const unsigned int hlls_len = 4096;
+  const unsigned int small_precision = 10;
+  hll_t *hlls = malloc(hlls_len * sizeof(*hlls));
+  hll_t **pointers = malloc(hlls_len * sizeof(*pointers));
+  long long *counts = malloc(hlls_len * sizeof(*counts));
+  if (hlls == NULL || pointers == NULL || counts == NULL)
+  {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  for (unsigned int i = 0; i < hlls_len; ++i)
+  {
+    bench_dense(&hlls[i], small_precision);
+    for (unsigned int j = 0; j < 1000; ++j)
+      hll_add_hash(&hlls[i], bench_random());
+    pointers[i] = &hlls[i];
+  }
+  for (unsigned int threads = 1; threads <= BENCH_THREADS; threads *= 2)
+  {
+    double best = 0;
+    for (int repeat = 0; repeat < BENCH_REPEAT; ++repeat)
+    {
+      double start = bench_now();
+      bench_check(hll_count_many(pointers, hlls_len, counts, threads),
+                  "hll_count_many");
+      double elapsed = bench_now() - start;
+      if (repeat == 0 || elapsed < best)
+        best = elapsed;
+      bench_sink += counts[0];
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "count_many_%u", threads);
+    bench_record(name, small_precision, hlls_len, "ns_per_hll",
+                 best / hlls_len);
+  }
+  for (unsigned int threads = 1; threads <= BENCH_THREADS; threads *= 2)
+  {
+    hll_pool_t pool;
+    bench_check(hll_pool_init(&pool, threads), "hll_pool_init");
+    double best = 0;
+    for (int repeat = 0; repeat < BENCH_REPEAT; ++repeat)
+    {
+      double start = bench_now();
+      bench_check(hll_count_many_pool(&pool, pointers, hlls_len, counts),
+                  "hll_count_many_pool");
+      double elapsed = bench_now() - start;
+      if (repeat == 0 || elapsed < best)
+        best = elapsed;
+      bench_sink += counts[0];
+    }
+    bench_check(hll_pool_destroy(&pool), "hll_pool_destroy");
+    char name[32];
+    snprintf(name, sizeof(name), "count_many_pool_%u", threads);
+    bench_record(name, small_precision, hlls_len, "ns_per_hll",
+                 best / hlls_len);
+  }
+  for (unsigned int i = 0; i < hlls_len; ++i)
+    hll_destroy(&hlls[i]);
+  free(hlls);
+  free(pointers);
+  free(counts);
+}
+#endif
+
+// Set the registers of a dense hll as if [n] distinct random hashes
+// were inserted. A register is at most k with probability
+// (1 - 2^-k / m)^n, registers are drawn independently by inversion.
+static void bench_simulate(hll_t *hll, double n)
+{
+  const unsigned int registers_len = 1u << hll->precision;
+  const unsigned int max = sizeof(hll_hash_t) * 8 - hll->precision + 1;
+  for (unsigned int i = 0; i < registers_len; ++i)
+  {
+    double x = registers_len * -expm1(log(bench_uniform()) / n);
+    unsigned int k = (x >= 1) ? 0 : (unsigned int)ceil(-log2(x));
+    hll_set_register(hll, i, (k > max) ? max : k);
+  }
+}
+
+// Cardinalities of the error curves, 1, 2 and 5 for each power of
+// ten from 10^3 to 10^10
+static double bench_cardinality(unsigned int i)
+{
+  static const double steps[3] = { 1, 2, 5 };
+  return steps[i % 3] * pow(10, 3 + i / 3);
+}
+#define BENCH_CARDINALITIES 22
+
+static void bench_error(void)
+{
+  static const struct {
+    const char *name;
+    unsigned int estimator;
+  } estimators[2] = {
+    { "error_hllpp", HLL_ESTIMATOR_HLLPP },
+    { "error_ertl", HLL_ESTIMATOR_ERTL },
+  };
+
+  for (unsigned int precision = HLL_PRECISION_MIN;
+       precision <= HLL_PRECISION_MAX; ++precision)
+  {
+    double sum[BENCH_CARDINALITIES][2] = {{0}};
+    double squares[BENCH_CARDINALITIES][2] = {{0}};
+
+    for (int run = 0; run < BENCH_RUNS; ++run)
+    {
+      // Small cardinalities go through the sparse representation too
+      hll_t hll;
+      bench_check(hll_init(&hll, .precision = precision), "hll_init");
+      unsigned long long inserted = 0;
+      for (unsigned int c = 0; c < BENCH_CARDINALITIES; ++c)
+      {
+        const double n = bench_cardinality(c);
+        if (n <= BENCH_INSERT_MAX)
+        {
+          for (; inserted < (unsigned long long)n; ++inserted)
+            bench_check(hll_add_hash(&hll, bench_random()), "hll_add_hash");
+        } else {
+          if (c == 0 || bench_cardinality(c - 1) <= BENCH_INSERT_MAX)
+          {
+            hll_destroy(&hll);
+            bench_dense(&hll, precision);
+          }
+          bench_simulate(&hll, n);
+        }
+
+        for (int e = 0; e < 2; ++e)
+        {
+          hll.estimator = estimators[e].estimator;
+          long long count = hll_count(&hll);
+          if (count < 0)
+            bench_check((hll_error)count, "hll_count");
+          double error = (count - n) / n;
+          sum[c][e] += error;
+          squares[c][e] += error * error;
+        }
+      }
+      hll_destroy(&hll);
+    }
+
+    for (unsigned int c = 0; c < BENCH_CARDINALITIES; ++c)
+      for (int e = 0; e < 2; ++e)
+      {
+        const unsigned long long n =
+          (unsigned long long)bench_cardinality(c);
+        bench_record(estimators[e].name, precision, n,
+                     "mean_relative_error", sum[c][e] / BENCH_RUNS);
+        bench_record(estimators[e].name, precision, n,
+                     "rms_relative_error",
+                     sqrt(squares[c][e] / BENCH_RUNS));
+      }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  static const struct {
+    const char *name;
+    void (*run)(void);
+  } suites[] = {
+    { "add", bench_add },
+    { "count", bench_count },
+    { "merge", bench_merge },
+#ifdef HLL_THREADS
+    { "parallel", bench_parallel },
+#endif
+    { "error", bench_error },
+  };
+  const unsigned int suites_len = sizeof(suites) / sizeof(suites[0]);
+
+  for (int i = 1; i < argc; ++i)
+  {
+    unsigned int s = 0;
+    while (s < suites_len && strcmp(argv[i], suites[s].name) != 0)
+      ++s;
+    if (s == suites_len)
+    {
+      fprintf(stderr, "usage: %s [add] [count] [merge] [parallel] [error]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  printf("# hll.h benchmarks, %d error runs\n", BENCH_RUNS);
+  printf("benchmark,precision,n,metric,value\n");
+  for (unsigned int s = 0; s < suites_len; ++s)
+  {
+    int selected = (argc == 1);
+    for (int i = 1; i < argc; ++i)
+      if (strcmp(argv[i], suites[s].name) == 0)
+        selected = 1;
+    if (selected)
+    {
+      suites[s].run();
+      fflush(stdout);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+//
+// hll_add built with HLL_HASH_INLINE, for the add suite of bench.c
+//
+// The implementation is private to this file, so that bench.c keeps
+// calling the hash function through the hash field of the hll.
+//
+
+#define HLL_DEF static inline
+#define HLL_HASH_INLINE
+#define HLL_IMPLEMENTATION
+#include "hll.h"
+
+// Insert [len] elements in a dense hll with [precision] and return
+// its estimate, or a negative hll_error
+long long bench_inline_add(unsigned int precision,
+                           char **elements,
+                           const unsigned int *lengths,
+                           unsigned int len);
+
+long long bench_inline_add(unsigned int precision,
+                           char **elements,
+                           const unsigned int *lengths,
+                           unsigned int len)
+{
+  hll_t hll;
+  hll_error err = hll_init(&hll,
+                           .precision = precision,
+                           .register_bits = 8,
+                           .representation = HLL_REPRESENTATION_DENSE);
+  if (err != HLL_OK)
+    return err;
+
+  for (unsigned int i = 0; i < len; ++i)
+    if ((err = hll_add(&hll, elements[i], lengths[i])) != HLL_OK)
+    {
+      hll_destroy(&hll);
+      return err;
+    }
+
+  long long count = hll_count(&hll);
+  hll_destroy(&hll);
+  return count;
+}
@@ -3,9 +3,13 @@
 // Mail:    giovanni.santini@proton.me
 // Github:  @San7o
 
+unsigned int integer_hash(unsigned int a, unsigned int _b);
+
 #define HLL_IMPLEMENTATION
 #define HLL_ELEMENT_T unsigned int
+#define HLL_HASH_T unsigned int
 #define HLL_HASH_FUNC integer_hash
+#define HLL_HASH_INLINE
 #include "hll.h"
 
 #include <assert.h>
@@ -54,11 +58,11 @@ int main(void)
     if (unique_numbers[i])
       expected++;
 
-  int estimate = hll_count(&hll);
+  long long estimate = hll_count(&hll);
   assert(estimate >= 0);
 
   printf("Expected: %d\n", expected);
-  printf("Estimate: %d\n", estimate);
+  printf("Estimate: %lld\n", estimate);
   
   assert(hll_destroy(&hll) == HLL_OK);
   return 0;
@@ -26,6 +26,12 @@
 // Features:
 //   - Header-only, portable C99 implementation
 //   - Adjustable precision/space-accuracy tradeoff
+//   - Registers packed in 6 or 8 bits
+//   - HyperLogLog++ sparse representation for low cardinalities
+//   - HyperLogLog++ empirical bias correction
+//   - Improved raw estimator of Ertl as an alternative
+//   - 64 bit hashes, XXH64 by default
+//   - Versioned serialization and zero-copy views of serialized hlls
 //   - Suitable for large-scale data streams
 //
 // Reference:
@@ -76,14 +82,14 @@
 //     https://github.com/San7o/micro-headers
 //
 //
-// TODO
-// ----
+// Choosing the precision
+// ----------------------
 //
-// The library should be tested more. Right now, some precision values
-// do not work well so the optimal precision should be handpicked
-// manually.
-// Only the dense representation is implemented.
-// Additionally, no empirical bias correction is applied.
+// The relative standard error of the estimate is about 1.04 /
+// sqrt(2^precision), and the registers take HLL_REGISTERS_SIZE bytes.
+// Instead of a precision, an hll can be initialized with a
+// target_error or a memory_budget and the precision gets chosen from
+// them, see hll_t.
 //
 
 #ifndef HLL
@@ -114,14 +120,80 @@ extern "C" {
   #define HLL_PRECISION 10
 #endif
 
+// Config: the default number of bits used to store each register.
+//
+// Note: Must be either 6 (four registers packed in three bytes) or 8
+// (one byte per register)
+#ifndef HLL_REGISTER_BITS
+  #define HLL_REGISTER_BITS 8
+#endif
+
+// Config: the default estimator used by hll_count, either
+// HLL_ESTIMATOR_HLLPP or HLL_ESTIMATOR_ERTL
+#ifndef HLL_ESTIMATOR
+  #define HLL_ESTIMATOR HLL_ESTIMATOR_HLLPP
+#endif
+
+// Config: the default representation of a newly initialized hll,
+// either HLL_REPRESENTATION_DENSE or HLL_REPRESENTATION_SPARSE
+#ifndef HLL_REPRESENTATION
+  #define HLL_REPRESENTATION HLL_REPRESENTATION_DENSE
+#endif
+
+// Config: precision of the index used by the sparse representation
+//
+// Note: Must be in range (HLL_PRECISION_MAX..25]
+#ifndef HLL_SPARSE_PRECISION
+  #define HLL_SPARSE_PRECISION 25
+#endif
+
+// Config: number of entries in the insertion buffer of the sparse
+// representation. The buffer gets sorted and merged in the sparse
+// list when full.
+#ifndef HLL_SPARSE_BUFFER_LEN
+  #define HLL_SPARSE_BUFFER_LEN 64
+#endif
+
+// Config: number of elements hashed at once by the batch insertion
+// functions before updating the registers
+#ifndef HLL_BATCH_LEN
+  #define HLL_BATCH_LEN 32
+#endif
+
+// Config: number of register bytes merged from every source before
+// moving to the next block in hll_merge_many. Should fit in the L1
+// cache together with a source block.
+#ifndef HLL_MERGE_BLOCK
+  #define HLL_MERGE_BLOCK 4096
+#endif
+
+// Config: size in bytes of a cache line. The shards of an
+// hll_sharded_t are aligned to it.
+#ifndef HLL_CACHE_LINE
+  #define HLL_CACHE_LINE 64
+#endif
+
+// Config: maximum number of (timestamp, rank) pairs kept by each
+// register of a sliding window hll. When a list is full the oldest
+// pair is dropped, which can only lower counts of long windows.
+//
+// Note: Must be in range [1..255]
+#ifndef HLL_WINDOW_DEPTH
+  #define HLL_WINDOW_DEPTH 16
+#endif
+
 // Config: element type that can be added in hll
 #ifndef HLL_ELEMENT_T
   #define HLL_ELEMENT_T char*
 #endif
 
 // Config: hash type
+//
+// Note: Should be an unsigned integer of 32 or 64 bits. With a 32
+// bit hash the estimate degrades for cardinalities close to 2^32.
 #ifndef HLL_HASH_T
-  #define HLL_HASH_T unsigned int
+  #include <stdint.h>
+  #define HLL_HASH_T uint64_t
 #endif
 
 // Config: the hash input value
@@ -131,7 +203,84 @@ extern "C" {
 
 // Config: The default hash function
 #ifndef HLL_HASH_FUNC
-  #define HLL_HASH_FUNC hll_hash_string
+  #define HLL_HASH_FUNC hll_hash_string64
+  #ifndef HLL_HASH_ID
+    #define HLL_HASH_ID HLL_HASH_ID_XXH64
+  #endif
+#endif
+
+// Config: identifier of the default hash function, stored in
+// serialized hlls. Use a value above HLL_HASH_ID_USER for your own
+// hash functions.
+#ifndef HLL_HASH_ID
+  #define HLL_HASH_ID HLL_HASH_ID_UNSPECIFIED
+#endif
+
+// Config: call HLL_HASH_FUNC directly instead of the hash field of
+// the hll, so that the compiler can inline it in hll_add and the
+// batch insertion functions
+//
+// Note: the hash field of the hlls and of the sliding window hlls is
+// ignored. HLL_HASH_FUNC must be declared before including the
+// implementation. The add suite of bench.c measures hll_add with and
+// without it ("add_inline" and "add").
+// #define HLL_HASH_INLINE
+
+// Config: keep counters of the operations on each hll in its stats
+// field, and call its hooks around hll_count, hll_merge and
+// hll_merge_many
+//
+// Note: adds the stats and hooks fields to hll_t, so it must be
+// defined in every file including hll.h. The counters of concurrent
+// hlls are updated atomically, which makes the threads contend on
+// them.
+// #define HLL_STATS
+
+// Config: Prefetch the cache line of an address for writing
+//
+// Note: Should behave like __builtin_prefetch(addr, 1)
+#ifndef HLL_PREFETCH
+  #if defined(__GNUC__) || defined(__clang__)
+    #define HLL_PREFETCH(addr) __builtin_prefetch((addr), 1)
+  #else
+    #define HLL_PREFETCH(addr) ((void)(addr))
+  #endif
+#endif
+
+// Config: disable the SSE2, AVX2 and NEON code paths
+//
+// Note: vector code is only compiled when the target supports it,
+// e.g. AVX2 requires building with -mavx2
+// #define HLL_NO_SIMD
+
+// Config: enable the memory mapped sketch store, see hll_store_t
+//
+// Note: requires a POSIX system. Define _POSIX_C_SOURCE to 200809L or
+// higher before including any header.
+// #define HLL_MMAP
+
+// Config: enable hll_add_many_parallel
+//
+// Note: requires POSIX threads, build with -pthread
+// #define HLL_THREADS
+
+// Config: maximum number of threads used by the parallel functions
+#ifndef HLL_THREADS_MAX
+  #define HLL_THREADS_MAX 64
+#endif
+
+// Config: number of elements hashed in each round of
+// hll_add_many_parallel. A round buffers two hashes per element.
+#ifndef HLL_PARALLEL_CHUNK
+  #define HLL_PARALLEL_CHUNK (1u << 20)
+#endif
+
+// Config: minimum number of hlls counted by each thread of
+// hll_count_many and hll_count_many_pool. Smaller arrays use fewer
+// threads, down to the calling one alone, so that starting or waking
+// a thread does not cost more than the counts it takes over.
+#ifndef HLL_COUNT_MANY_MIN
+  #define HLL_COUNT_MANY_MIN 256
 #endif
 
 // Config: The allocator function.
@@ -150,28 +299,69 @@ extern "C" {
   #define HLL_FREE free
 #endif
 
-// Config: Base two floating point log function.
+// Config: double precision natural logarithm function
+//
+// Note: Should be used like log(3). The deprecated HLL_LOGF is used
+// when only it is defined.
+#if !defined(HLL_LOG) && defined(HLL_LOGF)
+  #define HLL_LOG HLL_LOGF
+#endif
+#ifndef HLL_LOG
+  #include <math.h>
+  #define HLL_LOG log
+#endif
+
+// Config: double precision square root function
 //
-// Note: Should be used like logf(3).
-#ifndef HLL_LOGF
+// Note: Should be used like sqrt(3).
+#ifndef HLL_SQRT
   #include <math.h>
-  #define HLL_LOGF logf
+  #define HLL_SQRT sqrt
 #endif
 
-// Config: floating point power function
+// Config: double precision exponential function
 //
-// Note: should be used like powf(3)
-#ifndef HLL_POWF
+// Note: Should be used like exp(3).
+#ifndef HLL_EXP
   #include <math.h>
-  #define HLL_POWF powf
+  #define HLL_EXP exp
 #endif
 
 //
 // Types
 //
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define HLL_PRECISION_MIN 4
-#define HLL_PRECISION_MAX 16
+#define HLL_PRECISION_MAX 18
+
+#if HLL_SPARSE_PRECISION <= HLL_PRECISION_MAX || HLL_SPARSE_PRECISION > 25
+  #error "HLL_SPARSE_PRECISION must be in range (HLL_PRECISION_MAX..25]"
+#endif
+
+// Hash identifiers, see HLL_HASH_ID
+#define HLL_HASH_ID_UNSPECIFIED 0
+#define HLL_HASH_ID_XXH64       1
+#define HLL_HASH_ID_DJB2        2
+#define HLL_HASH_ID_USER        256
+
+// Registers are stored in an array of 2^precision registers
+#define HLL_REPRESENTATION_DENSE  1
+// Registers are stored as a sorted list of (index, rank) pairs with
+// an index of HLL_SPARSE_PRECISION bits, and converted to the dense
+// representation when the list grows bigger than the dense registers
+#define HLL_REPRESENTATION_SPARSE 2
+
+// Raw HyperLogLog estimate with the HyperLogLog++ empirical bias
+// correction and linear counting for small cardinalities
+#define HLL_ESTIMATOR_HLLPP 1
+// Improved raw estimator of O. Ertl, "New cardinality estimation
+// algorithms for HyperLogLog sketches", computed from the histogram
+// of the register values. Accurate over the whole range without
+// empirical corrections.
+#define HLL_ESTIMATOR_ERTL  2
 
 typedef HLL_ELEMENT_T hll_element_t;
 typedef HLL_HASH_T hll_hash_t;
@@ -186,36 +376,228 @@ typedef HLL_HASH_INPUT_T hll_hash_input_t;
 // Returns: the hash value of the input
 typedef hll_hash_t (*hll_hash_func_t)(hll_hash_input_t, unsigned int);
 
+// Allocator of an hll, see hll_arena_t for a built-in one
+typedef struct {
+  // Allocate [count] * [size] bytes set to 0, like calloc(3)
+  void *(*calloc)(void *ctx, size_t count, size_t size);
+  // Free memory returned by calloc, like free(3)
+  void (*free)(void *ctx, void *ptr);
+  // Passed to calloc and free
+  void *ctx;
+} hll_allocator_t;
+
+// Counters of the operations on an hll, see HLL_STATS
+typedef struct {
+  // Elements and hashes inserted
+  unsigned long long inserts;
+  // Registers raised by the insertions. In the sparse representation,
+  // entries added or raised when the insertion buffer is flushed.
+  unsigned long long register_updates;
+  // Calls to hll_count
+  unsigned long long counts;
+  // Sources merged by hll_merge and hll_merge_many
+  unsigned long long merges;
+  // Conversions from the sparse to the dense representation
+  unsigned long long sparse_to_dense;
+} hll_stats_t;
+
+// Operations reported to the hooks of an hll
+#define HLL_OPERATION_COUNT 1
+#define HLL_OPERATION_MERGE 2
+
+// Callbacks around the operations on an hll, see HLL_STATS
+typedef struct hll_hooks hll_hooks_t;
+
+// Sparse representation of an hll
+//
+// Each entry encodes the HLL_SPARSE_PRECISION bits index idx' of an
+// hash in its upper bits. If the bits of idx' after the first
+// [precision] bits are all zero, the rank of the rest of the hash is
+// stored in the next 6 bits and the lowest bit is set to 1:
+//
+//    | idx' | rank | 1 |    or    | idx' | 0 | 0 |
+//
+// so that the dense register value can always be recovered.
+typedef struct {
+  // Sorted list of unique entries, each stored as a varint of the
+  // difference with the previous entry
+  unsigned char *list;
+  // Number of bytes used in list
+  unsigned int list_len;
+  // Number of entries in list
+  unsigned int list_count;
+  // Unsorted insertion buffer of HLL_SPARSE_BUFFER_LEN entries
+  uint32_t *buffer;
+  // Number of entries in buffer
+  unsigned int buffer_len;
+} hll_sparse_t;
+
 // HyperLogLog
 typedef struct {
-  // _registers[i] stores the maximum number of leading zero plus one
-  // for substream with index i
+  // Register i stores the maximum number of leading zero plus one
+  // for substream with index i. Registers are packed in
+  // [register_bits] bits each, use hll_get_register and
+  // hll_set_register to access them.
   //
   // The input stream of data element is divided into m substreams
   // using the first [precision] bits of the hash values, where m =
   // 2^[precision].
-  hll_hash_t *_registers;
+  unsigned char *_registers;
   // Number of bits used to calculate the substream value of an input
   // stream. Higher number means more substreams and more precision,
   // but requires more memory.
   //
   // Note: Must be a number in range [HLL_PRECISION_MIN..HLL_PRECISION_MAX]
   unsigned int precision;
+  // If not zero, the precision is chosen as the smallest one with a
+  // relative standard error of at most target_error, e.g. 0.01 for
+  // 1%, and the precision field is ignored.
+  //
+  // Note: an error smaller than the one of HLL_PRECISION_MAX returns
+  // HLL_ERROR_INVALID_PRECISION
+  double target_error;
+  // If not zero, the precision is at most the biggest one whose
+  // registers fit in memory_budget bytes, and the precision field is
+  // ignored. If register_bits is 0, 6 bit registers are used when
+  // target_error needs a precision that only fits with them, or
+  // without target_error when they fit a bigger precision.
+  //
+  // Note: a budget smaller than the registers of HLL_PRECISION_MIN
+  // returns HLL_ERROR_INVALID_PRECISION
+  size_t memory_budget;
   // The hash function
   hll_hash_func_t hash;
+  // Number of bits used to store each register, either 6 or 8. A
+  // value of 0 selects HLL_REGISTER_BITS.
+  //
+  // 8 bit registers are faster to access, 6 bit registers use 25%
+  // less memory. Both can hold any rank produced by the hash.
+  unsigned int register_bits;
+  // Current representation, either HLL_REPRESENTATION_DENSE or
+  // HLL_REPRESENTATION_SPARSE. A value of 0 selects HLL_REPRESENTATION.
+  //
+  // A sparse hll does not allocate _registers until it gets
+  // converted to the dense representation, which happens
+  // automatically.
+  unsigned int representation;
+  // Used when representation is HLL_REPRESENTATION_SPARSE
+  hll_sparse_t _sparse;
+  // If not zero, hll_add and hll_merge can be called concurrently
+  // from many threads on this hll. Registers are updated with an
+  // atomic compare and swap, and only when the rank is bigger.
+  //
+  // Note: requires 8 bit registers and the dense representation.
+  // hll_count can run concurrently with the updates and returns an
+  // estimate of a recent state. Other functions are not thread safe.
+  int concurrent;
+  // If not zero, register updates maintain the harmonic sum of the
+  // registers and the number of zero registers, so hll_count does
+  // not read the registers. The estimate is cached until the hll
+  // changes.
+  //
+  // Note: can not be used together with concurrent. The
+  // HLL_ESTIMATOR_ERTL estimator reads the registers again when they
+  // change.
+  int cached;
+  // If not zero, the registers changed since the last
+  // hll_export_delta are marked in a bitmap, so that the delta only
+  // holds them.
+  //
+  // Note: requires the dense representation, and can not be used
+  // together with concurrent. Merges into the hll update one
+  // register at a time.
+  int track_changes;
+  // Bitmap of the changed registers, used when track_changes is set
+  unsigned char *_changes;
+  // Estimator used by hll_count, either HLL_ESTIMATOR_HLLPP or
+  // HLL_ESTIMATOR_ERTL. A value of 0 selects HLL_ESTIMATOR.
+  unsigned int estimator;
+  // Allocator used for the memory of this hll. A value of NULL
+  // selects HLL_CALLOC and HLL_FREE.
+  //
+  // Note: must outlive the hll
+  const hll_allocator_t *allocator;
+#ifdef HLL_STATS
+  // Counters of the operations on this hll, reset by the init
+  // functions
+  hll_stats_t stats;
+  // Callbacks around hll_count and the merges. A value of NULL
+  // disables them.
+  //
+  // Note: must outlive the hll
+  const hll_hooks_t *hooks;
+#endif
+  // Identifier of the hash function, see HLL_HASH_ID. Serialized
+  // hlls can only be loaded by an hll with the same hash_id, unless
+  // one of them is HLL_HASH_ID_UNSPECIFIED.
+  uint32_t hash_id;
+  // Internal flags, see _HLL_FLAG_*
+  unsigned int _flags;
+  // Sum of 2^-register over all registers, used when cached is set
+  double _sum;
+  // Number of zero registers, used when cached is set
+  unsigned int _zeros;
+  // Last estimate, used when cached is set
+  long long _count;
 } hll_t;
 
+struct hll_hooks {
+  // Called before hll_count, hll_merge and hll_merge_many with the
+  // hll to count or the destination of the merge, and one of
+  // HLL_OPERATION_*. Can be NULL.
+  void (*before)(void *ctx, const hll_t *hll, unsigned int operation);
+  // Called after them with their return value. Can be NULL.
+  void (*after)(void *ctx,
+                const hll_t *hll,
+                unsigned int operation,
+                long long result);
+  // Passed to the callbacks
+  void *ctx;
+};
+
+// _registers or _sparse.list point to memory owned by the user, they
+// must not be freed
+#define _HLL_FLAG_BORROWED 1
+// The registers changed since _count was computed
+#define _HLL_FLAG_DIRTY 2
+// The registers were written in bulk, _sum and _zeros must be
+// computed again
+#define _HLL_FLAG_SUM_STALE 4
+
+// Size in bytes of the bitmap of changed registers, see track_changes
+#define _HLL_CHANGES_SIZE(precision) ((1u << (precision)) / 8)
+
+// Size in bytes of the register array of an hll with the given
+// precision and register_bits
+#define HLL_REGISTERS_SIZE(precision, register_bits) \
+  (((1u << (precision)) * (register_bits)) / 8)
+
+// Maximum value of a register, it can be stored in 6 bits
+//
+// Note: used to be a function-like macro of the register bits
+#define HLL_REGISTER_MAX 63
+
 //
 // Errors
 //
 
 typedef int hll_error;
-#define HLL_OK                       0
-#define HLL_ERROR_HLL_NULL          -1
-#define HLL_ERROR_INVALID_PRECISION -2
-#define HLL_ERROR_HLL_UNINITIALIZED -3
-#define HLL_ERROR_ALLOCATING_MEMORY -4
-#define _HLL_ERROR_MAX              -5
+#define HLL_OK                           0
+#define HLL_ERROR_HLL_NULL              -1
+#define HLL_ERROR_INVALID_PRECISION     -2
+#define HLL_ERROR_HLL_UNINITIALIZED     -3
+#define HLL_ERROR_ALLOCATING_MEMORY     -4
+#define HLL_ERROR_INVALID_REGISTER_BITS -5
+#define HLL_ERROR_INVALID_REPRESENTATION -6
+#define HLL_ERROR_PRECISION_MISMATCH    -7
+#define HLL_ERROR_BUFFER_TOO_SMALL      -8
+#define HLL_ERROR_INVALID_FORMAT        -9
+#define HLL_ERROR_HASH_MISMATCH         -10
+#define HLL_ERROR_IO                    -11
+#define HLL_ERROR_INVALID_SLOT          -12
+#define HLL_ERROR_UNSUPPORTED           -13
+#define HLL_ERROR_INVALID_ESTIMATOR     -14
+#define _HLL_ERROR_MAX                  -15
 
 //
 // Function Definitions
@@ -229,17 +611,19 @@ typedef int hll_error;
 //
 // Returns: 0 on success, or a negative hll_error
 //
-// Notes: Allocates memory with HLL_CALLOC. You should call
-// hll_destroy when you are done.
+// Notes: Allocates memory with the allocator of the hll. You should
+// call hll_destroy when you are done.
 //
 // Example:
 // hll_t my_hll;
 // hll_init(&my_hll, .precision = 10);
+// hll_init(&my_hll, .target_error = 0.01, .memory_budget = 8192);
 #define hll_init(hll, ...) _hll_init_impl(      \
   hll,                                          \
   &(hll_t) {                                    \
     .precision = HLL_PRECISION,                 \
     .hash = HLL_HASH_FUNC,                      \
+    .hash_id = HLL_HASH_ID,                     \
     __VA_ARGS__,                                \
   })
 
@@ -251,10 +635,72 @@ typedef int hll_error;
 //
 // Returns: 0 on success, or a negative hll_error
 //
-// Notes: Allocates memory with HLL_CALLOC. You should call
-// hll_destroy when you are done.
+// Notes: Allocates memory with the allocator of the hll. You should
+// call hll_destroy when you are done.
 HLL_DEF hll_error _hll_init_impl(hll_t *hll, hll_t *hll_src);
 
+// Initialize hll with fields, storing the registers in caller memory
+//
+// Args:
+//  - arg1: a pointer to the hll to initialize
+//  - memory: memory for the registers, at least
+//    HLL_REGISTERS_SIZE(precision, register_bits) bytes. Must outlive
+//    the hll.
+//  - memory_len: size of memory in bytes
+//  - args...: hll fields
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: no memory is allocated and the hll always uses the dense
+// representation, so track_changes is not supported. The memory is
+// zeroed, and hll_destroy does not free it. See HLL_EMBEDDED_T to
+// keep the registers next to the hll.
+//
+// Example:
+// unsigned char registers[HLL_REGISTERS_SIZE(10, 8)];
+// hll_init_memory(&my_hll, registers, sizeof(registers),
+//                 .precision = 10, .register_bits = 8);
+#define hll_init_memory(hll, memory, memory_len, ...)                  \
+  _hll_init_memory_impl(                                               \
+    hll,                                                               \
+    memory,                                                            \
+    memory_len,                                                        \
+    &(hll_t) {                                                         \
+      .precision = HLL_PRECISION,                                      \
+      .hash = HLL_HASH_FUNC,                                           \
+      .hash_id = HLL_HASH_ID,                                          \
+      __VA_ARGS__,                                                     \
+    })
+
+// Initialize hll in caller memory, see hll_init_memory
+HLL_DEF hll_error _hll_init_memory_impl(hll_t *hll,
+                                        void *memory,
+                                        size_t memory_len,
+                                        hll_t *hll_src);
+
+// Type of an hll followed by its registers, can be placed in hash
+// table values or on the stack. Initialize it with
+// hll_init_embedded.
+//
+// Example:
+// HLL_EMBEDDED_T(10, 8) slot;
+// hll_init_embedded(&slot, .precision = 10, .register_bits = 8);
+// hll_add(&slot.hll, "x", 1);
+#define HLL_EMBEDDED_T(precision, register_bits)                       \
+  struct {                                                             \
+    hll_t hll;                                                         \
+    unsigned char registers[HLL_REGISTERS_SIZE(precision,              \
+                                               register_bits)];        \
+  }
+
+// Initialize an HLL_EMBEDDED_T with hll fields, see hll_init_memory
+//
+// Notes: the precision and register_bits fields must match the ones
+// of the type
+#define hll_init_embedded(embedded, ...)                               \
+  hll_init_memory(&(embedded)->hll, (embedded)->registers,             \
+                  sizeof((embedded)->registers), __VA_ARGS__)
+
 // Initialize hll
 //
 // Args:
@@ -275,7 +721,8 @@ HLL_DEF hll_error hll_init2(hll_t *hll,
 //
 // Returns: 0 on success, or a negative hll_error
 //
-// Notes: uses HLL_FREE. Must be called after hll_init or hll_init2
+// Notes: uses the allocator of the hll. Must be called after
+// hll_init or hll_init2
 HLL_DEF hll_error hll_destroy(hll_t *hll);
 
 // Add an element to the hll structure
@@ -290,6 +737,64 @@ HLL_DEF hll_error hll_add(hll_t *hll,
                           hll_element_t element,
                           unsigned int element_len);
 
+// Add an array of elements to the hll structure
+//
+// Args:
+//  - hll: pointer to the hll struct
+//  - elements: array of [n] elements to insert
+//  - lengths: array of [n] lengths, one for each element
+//  - n: number of elements
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: elements are hashed in batches of HLL_BATCH_LEN, and the
+// registers of a batch are prefetched before being updated
+HLL_DEF hll_error hll_add_many(hll_t *hll,
+                               const hll_element_t *elements,
+                               const unsigned int *lengths,
+                               unsigned int n);
+
+// Add an array of elements with the same length to the hll structure
+//
+// Args:
+//  - hll: pointer to the hll struct
+//  - elements: array of [n] elements to insert
+//  - element_len: length of each element
+//  - n: number of elements
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: useful for fixed width keys such as integers, see
+// hll_add_many
+HLL_DEF hll_error hll_add_many_fixed(hll_t *hll,
+                                     const hll_element_t *elements,
+                                     unsigned int element_len,
+                                     unsigned int n);
+
+// Add an already hashed element to the hll structure
+//
+// Args:
+//  - hll: pointer to the hll struct
+//  - hash: hash of the element, computed with the hash function of
+//    the hll or an equivalent one
+//
+// Returns: 0 on success, or a negative hll_error
+HLL_DEF hll_error hll_add_hash(hll_t *hll, hll_hash_t hash);
+
+// Add an array of already hashed elements to the hll structure
+//
+// Args:
+//  - hll: pointer to the hll struct
+//  - hashes: array of [n] hashes to insert
+//  - n: number of hashes
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: see hll_add_many and hll_add_hash
+HLL_DEF hll_error hll_add_hashes(hll_t *hll,
+                                 const hll_hash_t *hashes,
+                                 unsigned int n);
+
 // Get an estimate of the cardinality of the elements
 //
 // Args:
@@ -297,199 +802,4906 @@ HLL_DEF hll_error hll_add(hll_t *hll,
 //
 // Returns: a non-negative estimation of the cardinality, or a
 // negative hll_error
-HLL_DEF int hll_count(hll_t *hll);
+HLL_DEF long long hll_count(hll_t *hll);
+
+// Get an estimate of the cardinality of many hlls
+//
+// Args:
+//  - hlls: array of [n] pointers to hll structures
+//  - n: number of hlls
+//  - counts: array of [n] results, each one is the return value of
+//    hll_count for the hll with the same index
+//  - threads: number of threads, counting the calling one. Used with
+//    HLL_THREADS, values above HLL_THREADS_MAX are clamped. Without
+//    it, or with 0 or 1, the calling thread counts every hll.
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: each thread counts a contiguous range of at least
+// HLL_COUNT_MANY_MIN hlls, while the registers of the next hll and
+// the header of the one after are prefetched. The threads are
+// started and joined by every call, use hll_count_many_pool to reuse
+// them across calls. The register sum of each hll is the vectorized
+// one of hll_count, so the speedup over a loop of hll_count comes
+// from the threads. With more than one thread, an hll must not appear
+// twice in the array.
+HLL_DEF hll_error hll_count_many(hll_t **hlls,
+                                 unsigned int n,
+                                 long long *counts,
+                                 unsigned int threads);
 
 // Merge hll stc into hll destination
 //
 // Args:
 //  - hll_dest: pointer to the destination hll structure
 //  - hll_src: pointer to the source hll structure
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: a source with higher precision than the destination gets
+// folded to the precision of the destination. A source with lower
+// precision returns HLL_ERROR_PRECISION_MISMATCH, use hll_fold on
+// the destination first.
 HLL_DEF hll_error hll_merge(hll_t *hll_dest, hll_t *hll_src);
 
-// Fast hash function for strings
+// Reduce the precision of an hll
 //
 // Args:
-//  - input: hash input
-//  - input_len: length of the input
+//  - hll: pointer to the hll structure
+//  - precision: the new precision, not higher than the current one
 //
-// Returns: the hashed value of the input
-HLL_DEF unsigned int hll_hash_string(char* input, unsigned int input_len);
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: the registers are recomputed as if the elements were
+// inserted in an hll with the new precision. Allocates memory with
+// the allocator of the hll, on errors the hll is left unchanged.
+HLL_DEF hll_error hll_fold(hll_t *hll, unsigned int precision);
 
-// Convert error value into string
+// Merge many hlls into hll destination
 //
 // Args:
-//  - error: the (negative) error valie
+//  - hll_dest: pointer to the destination hll structure
+//  - hll_srcs: array of [n] pointers to the source hll structures
+//  - n: number of sources
 //
-// Returns: a string describing the error
-HLL_DEF const char *hll_error_string(hll_error error);
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: dense 8 bit sources with the same precision of the
+// destination are merged in blocks of HLL_MERGE_BLOCK bytes, so the
+// destination block stays in cache while all the sources are read.
+// Other sources are merged one by one with hll_merge.
+HLL_DEF hll_error hll_merge_many(hll_t *hll_dest,
+                                 hll_t **hll_srcs,
+                                 unsigned int n);
 
 //
-// Implementation
+// Set operations
+//
+// These functions estimate the cardinality of unions and
+// intersections of sets reading the registers of their hlls once,
+// without merging them in a new hll.
 //
 
-#ifdef HLL_IMPLEMENTATION
+// Estimate the cardinality of the union of many hlls
+//
+// Args:
+//  - hlls: array of [n] pointers to hll structures
+//  - n: number of hlls
+//
+// Returns: a non-negative estimation of the cardinality, or a
+// negative hll_error
+//
+// Notes: estimates the merge of all the hlls with the lowest
+// precision, using the estimator of the first one. Dense hlls with
+// the same precision are read in blocks of HLL_MERGE_BLOCK registers
+// and their registers are summed from a histogram, otherwise the
+// hlls are merged in a temporary hll allocated with HLL_CALLOC and
+// counted with hll_count. The histogram sum is exact, while
+// hll_count sums 8 bit registers in single precision vector lanes,
+// which are exact while no register is above 16. Up to then the
+// estimate is the one of hll_count on the merge, above it the two
+// can differ by a relative 10^-5 at most.
+HLL_DEF long long hll_count_union(hll_t **hlls, unsigned int n);
 
-HLL_DEF hll_error _hll_init_impl(hll_t *hll, hll_t *hll_src)
-{
-  if (hll == NULL)
-    return HLL_ERROR_HLL_NULL;
+// Joint cardinality estimate of two sets A and B
+typedef struct {
+  // Elements only in A
+  long long a_only;
+  // Elements only in B
+  long long b_only;
+  // Elements in both A and B
+  long long intersection;
+  // Elements in A or B
+  long long total;
+  // Jaccard similarity, intersection / total, or 0 if both sets
+  // are empty
+  double jaccard;
+} hll_joint_t;
 
-  if (hll_src != NULL)
-    *hll = *hll_src;
+// Estimate the intersection and the differences of two hlls
+//
+// Args:
+//  - hll_a: pointer to the hll of A
+//  - hll_b: pointer to the hll of B
+//  - joint: set to the estimate
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: uses the joint maximum likelihood estimator of O. Ertl,
+// "New cardinality estimation methods for HyperLogLog sketches",
+// which is more accurate than the inclusion-exclusion of three
+// hll_count, by about three times for small intersections. The
+// registers of both hlls are compared in a single pass, then the
+// likelihood is maximized over histograms of the register values.
+// If the precisions differ or an hll is sparse, the hlls are first
+// copied in temporary hlls of the lowest precision allocated with
+// HLL_CALLOC.
+HLL_DEF hll_error hll_count_joint(hll_t *hll_a,
+                                  hll_t *hll_b,
+                                  hll_joint_t *joint);
 
-  if (hll->precision < HLL_PRECISION_MIN
-      || hll->precision > HLL_PRECISION_MAX)
-    return HLL_ERROR_INVALID_PRECISION;
-  
-  hll->_registers = HLL_CALLOC((1<<hll->precision), sizeof(hll_hash_t));
-  if (hll->_registers == NULL)
-    return HLL_ERROR_ALLOCATING_MEMORY;
-  
-  return HLL_OK;
-}
+// Estimate the cardinality of the intersection of two hlls
+//
+// Args:
+//  - hll_a: pointer to the hll of A
+//  - hll_b: pointer to the hll of B
+//
+// Returns: a non-negative estimation of the cardinality, or a
+// negative hll_error
+//
+// Notes: see hll_count_joint
+HLL_DEF long long hll_count_intersection(hll_t *hll_a, hll_t *hll_b);
 
-HLL_DEF hll_error hll_init2(hll_t *hll,
-                   unsigned int precision)
-{
-  return _hll_init_impl(hll, &(hll_t){.precision = precision});
-}
+//
+// Arena allocator
+//
+// An arena carves the memory of many hlls out of a few big chunks.
+// Allocations up to block_size bytes, e.g. the registers of dense
+// hlls with the same precision, take a block that is reused once
+// freed. Bigger allocations are only reclaimed by hll_arena_reset,
+// which frees the memory of all the hlls of the arena at once and
+// keeps the chunks for the next ones.
+//
+// Example:
+// hll_arena_t arena;
+// hll_arena_init(&arena, HLL_REGISTERS_SIZE(14, 8), 0);
+// hll_init(&my_hll, .precision = 14, .allocator = &arena.allocator);
+//
 
-HLL_DEF hll_error hll_destroy(hll_t *hll)
-{
-  if (hll == NULL)
-    return HLL_ERROR_HLL_NULL;
+// Arena allocator
+typedef struct {
+  // Hooks to use as the allocator of the hlls
+  hll_allocator_t allocator;
+  // Size of the reusable blocks
+  size_t block_size;
+  // Number of blocks in a chunk
+  size_t chunk_blocks;
+  // List of chunks
+  void *_chunks;
+  // Chunk in use
+  void *_current;
+  // Bytes used in the chunk in use
+  size_t _used;
+  // List of allocations bigger than a chunk
+  void *_large;
+  // List of freed blocks
+  void *_free_blocks;
+} hll_arena_t;
 
-  if (hll->_registers == NULL)
-    return HLL_ERROR_HLL_UNINITIALIZED;
+// Initialize an arena
+//
+// Args:
+//  - arena: pointer to the arena to initialize. It must not be moved
+//    while in use, the hooks point to it.
+//  - block_size: size in bytes of the reusable blocks
+//  - chunk_blocks: number of blocks allocated at once with
+//    HLL_CALLOC, or 0 for 64
+//
+// Returns: 0 on success, or a negative hll_error
+HLL_DEF hll_error hll_arena_init(hll_arena_t *arena,
+                                 size_t block_size,
+                                 size_t chunk_blocks);
 
-  HLL_FREE(hll->_registers);
-  
-  return HLL_OK;
-}
+// Free the memory of all the hlls of an arena at once
+//
+// Args:
+//  - arena: pointer to an initialized arena
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: the hlls allocated from the arena must not be used, nor
+// destroyed, after this call. The chunks are kept and reused by the
+// next allocations.
+HLL_DEF hll_error hll_arena_reset(hll_arena_t *arena);
 
-HLL_DEF hll_hash_t hll_max(hll_hash_t a, hll_hash_t b)
-{
-  return (a > b) ? a : b;
-}
+// Free all the memory of an arena
+//
+// Args:
+//  - arena: pointer to an initialized arena
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: like hll_arena_reset, but the chunks are freed with
+// HLL_FREE too. The arena can be used again.
+HLL_DEF hll_error hll_arena_release(hll_arena_t *arena);
 
-HLL_DEF unsigned int
-hll_get_hash_zeros(hll_hash_t hash, unsigned int precision)
-{
-  hll_hash_t head = hash & ((1 << precision) - 1);
-  unsigned int count = 0;
-  for (unsigned int i = 0; i < sizeof(hll_hash_t)*8; ++i)
-  {
-    if (head & (1<<i))
-      break;
-    count++;
-  }
-  return count;
-}
-  
-HLL_DEF hll_error hll_add(hll_t *hll,
-                  hll_element_t element,
-                  unsigned int element_len)
-{
-  if (hll == NULL)
-    return HLL_ERROR_HLL_NULL;
+//
+// Serialization
+//
+// A serialized hll starts with a HLL_SERIALIZED_HEADER_SIZE bytes
+// header, all integers are little endian:
+//
+//   offset  size  field
+//        0     3  magic "HLL"
+//        3     1  format version, HLL_SERIALIZED_VERSION
+//        4     1  precision
+//        5     1  representation
+//        6     1  register_bits
+//        7     1  hash bits, 32 or 64
+//        8     4  hash_id
+//       12     4  number of sparse entries, 0 if dense
+//       16     4  payload length in bytes
+//
+// followed by the payload. The dense payload is the packed register
+// array, the sparse payload is the sorted varint list of sparse
+// entries, see hll_sparse_t.
+//
 
-  if (hll->_registers == NULL)
-    return HLL_ERROR_HLL_UNINITIALIZED;
+#define HLL_SERIALIZED_VERSION     1
+#define HLL_SERIALIZED_HEADER_SIZE 20
 
-  // Read the paper to understand what is happening
-  hll_hash_t hashed_elem = hll->hash(element, element_len);
-  unsigned int offset    = sizeof(hll_hash_t)*8 - hll->precision;
-  unsigned int mask      = ~((1 << offset) - 1);
-  hll_hash_t idx         = (hashed_elem & mask) >> offset;
-  hll_hash_t hash_zeros  = hll_get_hash_zeros(hashed_elem, hll->precision);
-  hll->_registers[idx]   = hll_max(hll->_registers[idx], hash_zeros + 1);
-  
-  return HLL_OK;
-}
+// Serialize an hll in a buffer
+//
+// Args:
+//  - hll: pointer to the hll to serialize
+//  - buffer: destination buffer, or NULL to only compute the size
+//  - buffer_len: size of buffer in bytes
+//  - written: set to the size of the serialized hll
+//
+// Returns: 0 on success, or a negative hll_error. If the buffer is
+// too small, returns HLL_ERROR_BUFFER_TOO_SMALL and sets [written]
+// to the required size.
+//
+// Notes: a sparse hll flushes its insertion buffer first, which may
+// convert it to the dense representation.
+HLL_DEF hll_error hll_serialize(hll_t *hll,
+                                void *buffer,
+                                size_t buffer_len,
+                                size_t *written);
+
+// Initialize hll from a serialized hll
+//
+// Args:
+//  - hll: pointer to the hll to initialize
+//  - buffer: the serialized hll
+//  - buffer_len: size of buffer in bytes
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: the hash function is set to HLL_HASH_FUNC. Allocates memory
+// with HLL_CALLOC and copies the registers, you should call
+// hll_destroy when you are done.
+#define hll_deserialize(hll, buffer, buffer_len)                      \
+  _hll_deserialize_impl(hll, buffer, buffer_len, NULL,                \
+                        HLL_HASH_FUNC, HLL_HASH_ID)
+
+// Initialize hll as a view of a serialized hll, without copying it
+//
+// Args:
+//  - hll: pointer to the hll to initialize
+//  - buffer: the serialized hll, e.g. a network packet or an mmap'd
+//    region. Must be writable and outlive the hll.
+//  - buffer_len: size of buffer in bytes
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: hll_count and hll_merge read the buffer directly, hll_add on
+// a dense view writes the registers in the buffer. A sparse view
+// allocates its own list on the first insertion. hll_destroy does not
+// free the buffer.
+#define hll_view(hll, buffer, buffer_len)                             \
+  _hll_view_impl(hll, buffer, buffer_len, HLL_HASH_FUNC, HLL_HASH_ID)
+
+// Initialize hll from a serialized hll, see hll_deserialize. If
+// [view] is not NULL, it is the writable buffer itself and the hll is
+// a view of it, see hll_view.
+HLL_DEF hll_error _hll_deserialize_impl(hll_t *hll,
+                                        const void *buffer,
+                                        size_t buffer_len,
+                                        void *view,
+                                        hll_hash_func_t hash,
+                                        uint32_t hash_id);
+
+// Initialize hll as a view of a serialized hll, see hll_view
+HLL_DEF hll_error _hll_view_impl(hll_t *hll,
+                                 void *buffer,
+                                 size_t buffer_len,
+                                 hll_hash_func_t hash,
+                                 uint32_t hash_id);
+
+//
+// Deltas
+//
+// A delta holds the registers of a dense hll changed since the last
+// exported delta, see track_changes, and brings a replica up to date
+// by max-merging them. A delta starts with a HLL_DELTA_HEADER_SIZE
+// bytes header, all integers are little endian:
+//
+//   offset  size  field
+//        0     4  magic "HLLD"
+//        4     1  format version, HLL_DELTA_VERSION
+//        5     1  precision
+//        6     1  hash bits, 32 or 64
+//        7     1  reserved, 0
+//        8     4  hash_id
+//       12     4  number of entries
+//       16     4  payload length in bytes
+//
+// followed by the entries sorted by register index. Each entry is
+// the varint of the difference between its index and the previous
+// one, or the index itself for the first entry, followed by one byte
+// with the value of the register.
+//
+
+#define HLL_DELTA_VERSION     1
+#define HLL_DELTA_HEADER_SIZE 20
+
+// Export the registers changed since the last delta
+//
+// Args:
+//  - hll: pointer to a dense hll
+//  - buffer: destination buffer, or NULL to only compute the size
+//  - buffer_len: size of buffer in bytes
+//  - written: set to the size of the delta
+//
+// Returns: 0 on success, or a negative hll_error. If the buffer is
+// too small, returns HLL_ERROR_BUFFER_TOO_SMALL and sets [written]
+// to the required size.
+//
+// Notes: the changes are cleared only when the delta is written. An
+// hll without track_changes exports all its non zero registers,
+// e.g. to send the first delta of a replica.
+HLL_DEF hll_error hll_export_delta(hll_t *hll,
+                                   void *buffer,
+                                   size_t buffer_len,
+                                   size_t *written);
+
+// Merge a delta in an hll
+//
+// Args:
+//  - hll: pointer to an hll with the precision of the delta
+//  - buffer: the delta
+//  - buffer_len: size of buffer in bytes
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: the delta is validated before any register changes. A
+// sparse hll is converted to the dense representation, as hll_merge
+// does with a dense source. Deltas can be applied in any order and
+// more than once.
+HLL_DEF hll_error hll_apply_delta(hll_t *hll,
+                                  const void *buffer,
+                                  size_t buffer_len);
+
+//
+// Sharded hll
+//
+// A sharded hll keeps one dense hll per thread, each on its own cache
+// lines, so threads adding elements to their shard never share
+// memory and need no atomics. The shards get merged only by
+// hll_sharded_count, which caches the estimate until a register of a
+// shard changes.
+//
+
+// Shard of an hll_sharded_t
+typedef struct {
+  hll_t hll;
+  // Set when a register of hll is raised, cleared when the shards
+  // get merged
+  int dirty;
+} hll_shard_t;
+
+// Sharded hll
+typedef struct {
+  // Memory holding the shards and their registers
+  unsigned char *_memory;
+  // First shard, aligned to HLL_CACHE_LINE
+  unsigned char *_shards;
+  // Distance in bytes between two shards
+  size_t _stride;
+  // Number of shards
+  unsigned int shards;
+  // Union of the shards, see hll_sharded_count
+  hll_t _merged;
+  // Estimate of _merged
+  long long _count;
+} hll_sharded_t;
+
+// Initialize a sharded hll with hll fields
+//
+// Args:
+//  - sharded: pointer to the sharded hll to initialize
+//  - shards: number of shards, usually the number of threads
+//  - args...: hll fields of every shard
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: shards always use the dense representation and are not
+// concurrent. Allocates memory with the allocator of the hll, you
+// should call hll_sharded_destroy when you are done.
+//
+// Example:
+// hll_sharded_t sharded;
+// hll_sharded_init(&sharded, 8, .precision = 14);
+#define hll_sharded_init(sharded, shards, ...) _hll_sharded_init_impl( \
+  sharded,                                                            \
+  shards,                                                             \
+  &(hll_t) {                                                          \
+    .precision = HLL_PRECISION,                                       \
+    .hash = HLL_HASH_FUNC,                                            \
+    .hash_id = HLL_HASH_ID,                                           \
+    __VA_ARGS__,                                                      \
+  })
+
+// Initialize a sharded hll from settings, see hll_sharded_init
+HLL_DEF hll_error _hll_sharded_init_impl(hll_sharded_t *sharded,
+                                         unsigned int shards,
+                                         hll_t *hll_src);
+
+// Destroy a sharded hll
+//
+// Args:
+//  - sharded: pointer to the sharded hll to delete
+//
+// Returns: 0 on success, or a negative hll_error
+HLL_DEF hll_error hll_sharded_destroy(hll_sharded_t *sharded);
+
+// Add an element to a shard of a sharded hll
+//
+// Args:
+//  - sharded: pointer to an initialized sharded hll
+//  - shard: index of the shard, e.g. the index of the calling thread
+//  - element: element to insert
+//  - element_len: length of the element
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: different threads can add to different shards at the same
+// time. A shard must be used by one thread at a time.
+HLL_DEF hll_error hll_sharded_add(hll_sharded_t *sharded,
+                                  unsigned int shard,
+                                  hll_element_t element,
+                                  unsigned int element_len);
+
+// Add an array of elements to a shard of a sharded hll
+//
+// Args:
+//  - sharded: pointer to an initialized sharded hll
+//  - shard: index of the shard
+//  - elements: array of [n] elements to insert
+//  - lengths: array of [n] lengths, one for each element
+//  - n: number of elements
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: see hll_add_many and hll_sharded_add
+HLL_DEF hll_error hll_sharded_add_many(hll_sharded_t *sharded,
+                                       unsigned int shard,
+                                       const hll_element_t *elements,
+                                       const unsigned int *lengths,
+                                       unsigned int n);
+
+// Get an estimate of the cardinality of the union of the shards
+//
+// Args:
+//  - sharded: pointer to an initialized sharded hll
+//
+// Returns: a non-negative estimation of the cardinality, or a
+// negative hll_error
+//
+// Notes: the shards are merged only if a register of one of them was
+// raised since the last call, otherwise the cached estimate is
+// returned. The shards are read without atomics, so no thread may add
+// elements during the call: count between batches, or after joining
+// the adding threads, or with a lock held around the adds and the
+// count. It must not be called by many threads at once.
+HLL_DEF long long hll_sharded_count(hll_sharded_t *sharded);
+
+//
+// Sliding window hll
+//
+// Sliding HyperLogLog by Y. Chabchoub and G. Hébrail: every register
+// keeps the list of future possible maxima, the (timestamp, rank)
+// pairs that can still be the maximum of a window ending now. The
+// ranks in a list decrease as the timestamps increase, so the oldest
+// pair inside a window holds the register value for that window.
+// Any window up to the horizon is counted with a single pass over
+// the registers, without merging sketches.
+//
+
+// Sliding window hll
+typedef struct {
+  // Timestamps of the pairs, HLL_WINDOW_DEPTH per register
+  uint32_t *_times;
+  // Ranks of the pairs, HLL_WINDOW_DEPTH per register
+  unsigned char *_ranks;
+  // Number of pairs of each register
+  unsigned char *_lens;
+  // Number of bits of the register index, see hll_t
+  unsigned int precision;
+  // The hash function
+  hll_hash_func_t hash;
+  // Pairs older than horizon time units are dropped
+  uint32_t horizon;
+  // Most recent timestamp
+  uint32_t _now;
+  // Allocator used for the memory of this window, see hll_t
+  const hll_allocator_t *allocator;
+} hll_window_t;
+
+// Initialize a sliding window hll
+//
+// Args:
+//  - window: pointer to the sliding window hll to initialize
+//  - precision: a number between HLL_PRECISION_MIN and
+//    HLL_PRECISION_MAX
+//  - horizon: longest window that can be counted, in the unit of the
+//    timestamps
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: uses HLL_HASH_FUNC. Allocates memory with HLL_CALLOC, or
+// with the allocator of hll_window_init_allocator, you should call
+// hll_window_destroy when you are done. On errors the window is left
+// zeroed.
+#define hll_window_init(window, precision, horizon) \
+  _hll_window_init_impl(window, precision, horizon, HLL_HASH_FUNC, NULL)
+
+// Initialize a sliding window hll whose memory comes from
+// [allocator], see hll_window_init. The allocator must outlive the
+// window.
+#define hll_window_init_allocator(window, precision, horizon, allocator) \
+  _hll_window_init_impl(window, precision, horizon, HLL_HASH_FUNC,      \
+                        allocator)
+
+// Initialize a sliding window hll, see hll_window_init
+HLL_DEF hll_error _hll_window_init_impl(hll_window_t *window,
+                                        unsigned int precision,
+                                        uint32_t horizon,
+                                        hll_hash_func_t hash,
+                                        const hll_allocator_t *allocator);
+
+// Destroy a sliding window hll
+//
+// Args:
+//  - window: pointer to the sliding window hll to delete
+//
+// Returns: 0 on success, or a negative hll_error
+HLL_DEF hll_error hll_window_destroy(hll_window_t *window);
+
+// Add an element seen at a given time to a sliding window hll
+//
+// Args:
+//  - window: pointer to an initialized sliding window hll
+//  - element: element to insert
+//  - element_len: length of the element
+//  - timestamp: time of the element, e.g. in seconds. Timestamps
+//    older than the most recent one are treated as the most recent.
+//
+// Returns: 0 on success, or a negative hll_error
+HLL_DEF hll_error hll_window_add(hll_window_t *window,
+                                 hll_element_t element,
+                                 unsigned int element_len,
+                                 uint32_t timestamp);
+
+// Add an already hashed element to a sliding window hll, see
+// hll_window_add
+HLL_DEF hll_error hll_window_add_hash(hll_window_t *window,
+                                      hll_hash_t hash,
+                                      uint32_t timestamp);
+
+// Get an estimate of the cardinality of the elements of a window
+//
+// Args:
+//  - window: pointer to an initialized sliding window hll
+//  - window_len: length of the window ending at the most recent
+//    timestamp, elements with a timestamp t such that
+//    now - t < window_len are counted. Clamped to the horizon.
+//
+// Returns: a non-negative estimation of the cardinality, or a
+// negative hll_error
+HLL_DEF long long hll_count_window(const hll_window_t *window,
+                                   uint32_t window_len);
+
+//
+// Streaming insertion
+//
+// A stream splits chunks of raw bytes, as read from a file or a
+// socket, in records ended by a delimiter or of a fixed length, and
+// adds each record to an hll. Records are hashed where they are in
+// the chunk, only a record split between two chunks is copied to be
+// completed by the next one.
+//
+
+// Hash function of the records of a stream, like hll_hash_bytes
+typedef uint64_t (*hll_stream_hash_func_t)(const void *bytes, size_t len);
+
+// Stream of records added to an hll
+typedef struct {
+  // The hll records are added to
+  hll_t *hll;
+  // Length of each record, or 0 for records ended by the delimiter
+  unsigned int record_len;
+  // Byte ending each record when record_len is 0
+  unsigned char delimiter;
+  // Hash function of the records, hll_hash_bytes by default. It
+  // matches hll_add with the default HLL_HASH_FUNC.
+  //
+  // Note: can be changed after the init, the new function must give
+  // the hash of hll_add for the bytes of each record
+  hll_stream_hash_func_t hash;
+  // Start of a record split between chunks
+  unsigned char *_carry;
+  unsigned int _carry_len;
+  unsigned int _carry_cap;
+} hll_stream_t;
+
+// Initialize a stream of records ended by a delimiter
+//
+// Args:
+//  - stream: pointer to the stream to initialize
+//  - hll: pointer to an initialized hll, the records are added to it
+//  - delimiter: byte ending each record, e.g. '\n'
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: empty records are skipped, and the last record of the
+// stream does not need a delimiter. The records are hashed with
+// hll_hash_bytes, which matches hll_add only when the hll hashes
+// with hll_hash_string64 and its hash_id is HLL_HASH_ID_XXH64. Other
+// hlls are rejected with HLL_ERROR_HASH_MISMATCH, even when their
+// hash_id is HLL_HASH_ID_UNSPECIFIED. Call hll_stream_finish when you
+// are done.
+HLL_DEF hll_error hll_stream_init(hll_stream_t *stream,
+                                  hll_t *hll,
+                                  unsigned char delimiter);
+
+// Initialize a stream of records of the same length
+//
+// Args:
+//  - stream: pointer to the stream to initialize
+//  - hll: pointer to an initialized hll, the records are added to it
+//  - record_len: length of each record, must not be 0
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: rejects the hlls of other hash functions like
+// hll_stream_init. Call hll_stream_finish when you are done.
+HLL_DEF hll_error hll_stream_init_fixed(hll_stream_t *stream,
+                                        hll_t *hll,
+                                        unsigned int record_len);
+
+// Add the records of a chunk of bytes
+//
+// Args:
+//  - stream: pointer to an initialized stream
+//  - chunk: the next [chunk_len] bytes of the stream
+//  - chunk_len: number of bytes of the chunk
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: complete records are hashed in place. The trailing partial
+// record is copied with the allocator of the hll and completed by
+// the next chunk, so the chunk can be reused after the call.
+HLL_DEF hll_error hll_stream_feed(hll_stream_t *stream,
+                                  const void *chunk,
+                                  size_t chunk_len);
+
+// Add the last record of a stream and release its memory
+//
+// Args:
+//  - stream: pointer to an initialized stream
+//
+// Returns: 0 on success, or a negative hll_error. A fixed length
+// stream ending with a partial record returns
+// HLL_ERROR_INVALID_FORMAT without adding it.
+HLL_DEF hll_error hll_stream_finish(hll_stream_t *stream);
+
+#ifdef HLL_MMAP
+
+// Add the records of a file to a stream
+//
+// Args:
+//  - stream: pointer to an initialized stream
+//  - path: path of the file
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: the file is mapped in memory and fed as a single chunk, so
+// its records are hashed in the page cache without copies. The
+// stream is not finished, more files or chunks can follow.
+HLL_DEF hll_error hll_stream_file(hll_stream_t *stream, const char *path);
+
+#endif // HLL_MMAP
+
+//
+// Sketch table
+//
+// A table holds [rows] dense hlls with the same settings in a single
+// allocation, one row of packed registers after the other, without
+// the header of an hll_t for each of them. Rows are addressed by a
+// key id, e.g. the index of a group in a group-by query.
+//
+
+// Table of hlls with the same settings
+typedef struct {
+  // Registers of all the rows, [row_size] bytes each
+  unsigned char *_registers;
+  // Number of rows
+  uint32_t rows;
+  // Size in bytes of each row, see HLL_REGISTERS_SIZE
+  uint32_t row_size;
+  // Settings of every row, without registers
+  hll_t _row;
+} hll_table_t;
+
+// Initialize a table of hlls with hll fields
+//
+// Args:
+//  - table: pointer to the table to initialize
+//  - rows: number of hlls in the table
+//  - args...: hll fields of every row
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: rows always use the dense representation and are not
+// cached, concurrent or tracked. Allocates the registers with the allocator
+// of the fields, you should call hll_table_destroy when you are
+// done.
+//
+// Example:
+// hll_table_t table;
+// hll_table_init(&table, 100000, .precision = 8, .register_bits = 6);
+#define hll_table_init(table, rows, ...) _hll_table_init_impl(         \
+  table,                                                              \
+  rows,                                                               \
+  &(hll_t) {                                                          \
+    .precision = HLL_PRECISION,                                       \
+    .hash = HLL_HASH_FUNC,                                            \
+    .hash_id = HLL_HASH_ID,                                           \
+    __VA_ARGS__,                                                      \
+  })
+
+// Initialize a table of hlls from settings, see hll_table_init
+HLL_DEF hll_error _hll_table_init_impl(hll_table_t *table,
+                                       uint32_t rows,
+                                       hll_t *hll_src);
+
+// Destroy a table of hlls
+//
+// Args:
+//  - table: pointer to the table to delete
+//
+// Returns: 0 on success, or a negative hll_error
+HLL_DEF hll_error hll_table_destroy(hll_table_t *table);
+
+// Add an element to a row of a table
+//
+// Args:
+//  - table: pointer to an initialized table
+//  - key_id: index of the row, less than the number of rows
+//  - element: element to insert
+//  - element_len: length of the element
+//
+// Returns: 0 on success, or a negative hll_error
+HLL_DEF hll_error hll_table_add(hll_table_t *table,
+                                uint32_t key_id,
+                                hll_element_t element,
+                                unsigned int element_len);
+
+// Add an already hashed element to a row of a table, see
+// hll_table_add and hll_add_hash
+HLL_DEF hll_error hll_table_add_hash(hll_table_t *table,
+                                     uint32_t key_id,
+                                     hll_hash_t hash);
+
+// Get an estimate of the cardinality of a row of a table
+//
+// Args:
+//  - table: pointer to an initialized table
+//  - key_id: index of the row
+//
+// Returns: a non-negative estimation of the cardinality, or a
+// negative hll_error
+HLL_DEF long long hll_table_count(hll_table_t *table, uint32_t key_id);
+
+// Merge every row of a table in the same row of another one
+//
+// Args:
+//  - table_dest: pointer to the destination table
+//  - table_src: pointer to the source table, with the same number
+//    of rows, precision and register_bits
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: tables with 8 bit registers are merged with a single
+// vectorized pass over the whole register matrix
+HLL_DEF hll_error hll_table_merge(hll_table_t *table_dest,
+                                  hll_table_t *table_src);
+
+// Get a row of a table as an hll
+//
+// Args:
+//  - table: pointer to an initialized table
+//  - key_id: index of the row
+//  - hll: pointer to the hll to initialize
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: the hll points inside the table, no memory is allocated.
+// It works with the rest of the API, e.g. to serialize or merge a
+// row, as long as it stays dense. It is valid until the table gets
+// destroyed, and must not be destroyed itself.
+HLL_DEF hll_error hll_table_get(hll_table_t *table,
+                                uint32_t key_id,
+                                hll_t *hll);
+
+#ifdef HLL_THREADS
+
+#include <pthread.h>
+
+//
+// Parallel insertion
+//
+
+// Add an array of elements to the hll structure using [threads]
+// threads
+//
+// Args:
+//  - hll: pointer to the hll struct
+//  - elements: array of [n] elements to insert
+//  - lengths: array of [n] lengths, one for each element
+//  - n: number of elements
+//  - threads: number of threads, counting the calling one. With 0 or
+//    1 the elements are inserted by the calling thread, values above
+//    HLL_THREADS_MAX are clamped.
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: elements are inserted in rounds of HLL_PARALLEL_CHUNK. In a
+// round each thread hashes a slice of the elements and buckets the
+// hashes by register range, then each thread updates the registers
+// of its range with its buckets from every slice. The ranges do not
+// share bytes, so the registers are written without atomics or
+// merges, and the result is the same of hll_add_many. A sparse hll
+// is converted to the dense representation first. The buffers of a
+// round only live for the call, so they are allocated with
+// HLL_CALLOC and not with the allocator of the hll, which may only
+// reclaim them later, like an arena does. The hash function must be
+// safe to call from multiple threads.
+HLL_DEF hll_error hll_add_many_parallel(hll_t *hll,
+                                        const hll_element_t *elements,
+                                        const unsigned int *lengths,
+                                        size_t n,
+                                        unsigned int threads);
+
+//
+// Thread pool
+//
+// A pool keeps its threads waiting between calls, so that a service
+// counting many hlls for each request does not start and join
+// threads every time. The calling thread works together with the
+// threads of the pool.
+//
+
+// Pool of threads
+typedef struct {
+  // Number of threads, counting the calling one
+  unsigned int threads;
+  pthread_t _workers[HLL_THREADS_MAX];
+  // Held by a call for its whole duration
+  pthread_mutex_t _run;
+  // Protects the fields below
+  pthread_mutex_t _lock;
+  // Signaled when tasks are posted or the pool is destroyed
+  pthread_cond_t _work;
+  // Signaled when the last task of a call ends
+  pthread_cond_t _done;
+  // Tasks of the current call, [_len] arguments of [_arg_size] bytes
+  void *(*_task)(void*);
+  unsigned char *_args;
+  size_t _arg_size;
+  unsigned int _len;
+  // Next task to start, and number of ended tasks
+  unsigned int _next;
+  unsigned int _finished;
+  int _stop;
+} hll_pool_t;
+
+// Initialize a pool of threads
+//
+// Args:
+//  - pool: pointer to the pool to initialize. It must not be moved
+//    while in use, the threads point to it.
+//  - threads: number of threads, counting the calling one. Values
+//    above HLL_THREADS_MAX are clamped, 0 is 1.
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: if some threads can not be started the pool keeps the
+// others, see the threads field. Call hll_pool_destroy when you are
+// done.
+HLL_DEF hll_error hll_pool_init(hll_pool_t *pool, unsigned int threads);
+
+// Stop and join the threads of a pool
+//
+// Args:
+//  - pool: pointer to an initialized pool, not in use by any call
+//
+// Returns: 0 on success, or a negative hll_error
+HLL_DEF hll_error hll_pool_destroy(hll_pool_t *pool);
+
+// Get an estimate of the cardinality of many hlls with the threads
+// of a pool
+//
+// Args:
+//  - pool: pointer to an initialized pool
+//  - hlls: array of [n] pointers to hll structures
+//  - n: number of hlls
+//  - counts: array of [n] results, each one is the return value of
+//    hll_count for the hll with the same index
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: like hll_count_many with the threads of the pool. Calls on
+// the same pool from many threads run one at a time.
+HLL_DEF hll_error hll_count_many_pool(hll_pool_t *pool,
+                                      hll_t **hlls,
+                                      unsigned int n,
+                                      long long *counts);
+
+#endif // HLL_THREADS
+
+#ifdef HLL_MMAP
+
+//
+// Memory mapped store
+//
+// A store is a single file holding [slots] dense hlls with the same
+// precision and register_bits. The file is mapped in memory, so
+// opening a store is a single mmap and register updates go straight
+// to the page cache. A new file is zero filled, so every slot starts
+// as an empty hll.
+//
+// File layout: a HLL_STORE_HEADER_SIZE bytes header, all integers
+// little endian:
+//
+//   offset  size  field
+//        0     4  magic "HLLS"
+//        4     1  format version, HLL_STORE_VERSION
+//        5     1  precision
+//        6     1  register_bits
+//        7     1  hash bits, 32 or 64
+//        8     4  hash_id
+//       12     4  number of slots
+//       16     4  slot size in bytes
+//
+// followed by the slots. Each slot is the packed register array,
+// padded to HLL_STORE_SLOT_ALIGN bytes.
+//
+
+#define HLL_STORE_VERSION     1
+#define HLL_STORE_HEADER_SIZE 64
+#define HLL_STORE_SLOT_ALIGN  64
+
+// Memory mapped store of hlls
+typedef struct {
+  // Mapped file
+  unsigned char *_base;
+  // Size of the mapping in bytes
+  size_t _size;
+  // File descriptor of the store
+  int _fd;
+  // Precision of every hll in the store
+  unsigned int precision;
+  // Register bits of every hll in the store
+  unsigned int register_bits;
+  // Identifier of the hash function, see HLL_HASH_ID
+  uint32_t hash_id;
+  // Number of slots
+  uint32_t slots;
+  // Size in bytes of each slot
+  uint32_t slot_size;
+} hll_store_t;
+
+// Open or create a store
+//
+// Args:
+//  - store: pointer to the store to initialize
+//  - path: path of the store file
+//  - precision: precision of the hlls
+//  - register_bits: register bits of the hlls, 6 or 8
+//  - slots: minimum number of hlls, the file grows if it has less
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: an existing store must have the same precision, register
+// bits and hash. You should call hll_store_close when you are done.
+#define hll_store_open(store, path, precision, register_bits, slots)  \
+  _hll_store_open_impl(store, path, precision, register_bits, slots,  \
+                       HLL_HASH_ID)
+
+// Open or create a store, see hll_store_open
+HLL_DEF hll_error _hll_store_open_impl(hll_store_t *store,
+                                       const char *path,
+                                       unsigned int precision,
+                                       unsigned int register_bits,
+                                       uint32_t slots,
+                                       uint32_t hash_id);
+
+// Get the hll in a slot of the store
+//
+// Args:
+//  - store: pointer to an open store
+//  - slot: index of the hll, less than the number of slots
+//  - hll: pointer to the hll to initialize
+//
+// Returns: 0 on success, or a negative hll_error. A slot of 8 bit
+// registers bigger than HLL_REGISTER_MAX, e.g. in a corrupted file,
+// returns HLL_ERROR_INVALID_FORMAT.
+//
+// Notes: the hll uses HLL_HASH_FUNC and points inside the mapping,
+// no memory is allocated. It is valid until the store gets closed.
+// The registers of the slot are read once to check them.
+#define hll_store_get(store, slot, hll) \
+  _hll_store_get_impl(store, slot, hll, HLL_HASH_FUNC)
+
+// Get the hll in a slot of the store, see hll_store_get
+HLL_DEF hll_error _hll_store_get_impl(hll_store_t *store,
+                                      uint32_t slot,
+                                      hll_t *hll,
+                                      hll_hash_func_t hash);
+
+// Flush the changes of a store to its file
+//
+// Args:
+//  - store: pointer to an open store
+//
+// Returns: 0 on success, or a negative hll_error
+HLL_DEF hll_error hll_store_sync(hll_store_t *store);
+
+// Close a store
+//
+// Args:
+//  - store: pointer to an open store
+//
+// Returns: 0 on success, or a negative hll_error
+//
+// Notes: the hlls of the store must not be used after this call
+HLL_DEF hll_error hll_store_close(hll_store_t *store);
+
+#endif // HLL_MMAP
+
+// Read the value of a register
+//
+// Args:
+//  - hll: pointer to an initialized hll structure
+//  - idx: index of the register, less than 2^precision
+//
+// Returns: the value of the register
+//
+// Notes: no bound checks are performed
+HLL_DEF unsigned int hll_get_register(const hll_t *hll, unsigned int idx);
+
+// Write the value of a register
+//
+// Args:
+//  - hll: pointer to an initialized hll structure
+//  - idx: index of the register, less than 2^precision
+//  - value: the new value, saturated to HLL_REGISTER_MAX
+//
+// Notes: no bound checks are performed. On a cached hll, the next
+// hll_count reads all the registers again.
+HLL_DEF void hll_set_register(hll_t *hll,
+                              unsigned int idx,
+                              unsigned int value);
+
+// Fast hash function for strings
+//
+// Args:
+//  - input: hash input
+//  - input_len: length of the input
+//
+// Returns: the hashed value of the input
+//
+// Notes: this is a 32 bit hash with poor mixing of the high bits,
+// prefer hll_hash_string64
+HLL_DEF unsigned int hll_hash_string(char* input, unsigned int input_len);
+
+// 64 bit hash function for bytes, this is XXH64 with seed 0
+//
+// Args:
+//  - bytes: hash input
+//  - len: number of bytes of the input
+//
+// Returns: the hashed value of the input
+HLL_DEF uint64_t hll_hash_bytes(const void *bytes, size_t len);
+
+// Default hash function for strings, based on hll_hash_bytes
+//
+// Args:
+//  - input: hash input
+//  - input_len: length of the input
+//
+// Returns: the hashed value of the input, truncated to hll_hash_t
+HLL_DEF hll_hash_t hll_hash_string64(char* input, unsigned int input_len);
+
+// Convert error value into string
+//
+// Args:
+//  - error: the (negative) error valie
+//
+// Returns: a string describing the error
+HLL_DEF const char *hll_error_string(hll_error error);
+
+// Number of leading zeros of an hash after its first [precision] bits
+//
+// Args:
+//  - hash: the hash value
+//  - precision: number of bits of the register index
+//
+// Returns: the number of leading zeros, the rank of the hash is this
+// value plus one
+HLL_DEF unsigned int hll_get_hash_zeros(hll_hash_t hash,
+                                        unsigned int precision);
+
+// Sum 2^-register over the registers of a dense hll and count the
+// zero registers, using SSE2, AVX2 or NEON when available
+HLL_DEF void _hll_registers_sum(const hll_t *hll,
+                                double *sum,
+                                unsigned int *zeros);
+
+// Estimate the cardinality of a dense hll from the harmonic sum of
+// its registers and the number of zero registers, see
+// HLL_ESTIMATOR_HLLPP
+HLL_DEF long long _hll_estimate(unsigned int precision,
+                                double sum,
+                                unsigned int num_of_zero_registers);
+
+//
+// Specialization
+//
+// HLL_SPECIALIZE generates static inline functions for hlls with a
+// fixed precision and hash function, 8 bit registers and the dense
+// representation. Shifts, masks and the estimator constants become
+// compile time constants, and the hash function can be inlined. The
+// count skips the representation and estimator dispatch and reuses
+// the vectorized register sum.
+//
+// Example:
+// HLL_SPECIALIZE(hll14, 14, hll_hash_string64, HLL_HASH_ID_XXH64)
+//
+// generates:
+//  - hll_error hll14_init(hll_t *hll): initialize an hll with the
+//    fixed settings, destroy it with hll_destroy
+//  - void hll14_add_hash(hll_t *hll, hll_hash_t hash)
+//  - hll_error hll14_add(hll_t *hll, hll_element_t element,
+//                        unsigned int element_len)
+//  - long long hll14_count(hll_t *hll)
+//
+// The generated functions perform no checks and must only be used
+// on hlls created by the init function. They can be mixed with the
+// rest of the API, except for concurrent and cached hlls. The count
+// always uses the HLL_ESTIMATOR_HLLPP estimator. The HLL_STATS
+// counters and hooks are not updated.
+//
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define _HLL_HASH_ZEROS(hash, precision)                              \
+    (sizeof(hll_hash_t) > 4                                             \
+     ? (unsigned int)__builtin_clzll((unsigned long long)(hash)         \
+                                     << (precision)                     \
+                                     | 1ULL << ((precision) - 1))       \
+     : (unsigned int)__builtin_clz((unsigned int)((hash) << (precision)) \
+                                   | 1u << ((precision) - 1)))
+#else
+  #define _HLL_HASH_ZEROS(hash, precision) \
+    hll_get_hash_zeros(hash, precision)
+#endif
+
+#define HLL_SPECIALIZE(name, fixed_precision, hash_func, hash_id_value) \
+  typedef char name##_precision_check                                   \
+    [(fixed_precision) >= HLL_PRECISION_MIN                             \
+     && (fixed_precision) <= HLL_PRECISION_MAX ? 1 : -1];               \
+                                                                        \
+  static inline hll_error name##_init(hll_t *hll)                       \
+  {                                                                     \
+    return _hll_init_impl(hll, &(hll_t) {                               \
+        .precision      = (fixed_precision),                            \
+        .hash           = (hash_func),                                  \
+        .register_bits  = 8,                                            \
+        .representation = HLL_REPRESENTATION_DENSE,                     \
+        .hash_id        = (hash_id_value),                              \
+      });                                                               \
+  }                                                                     \
+                                                                        \
+  static inline void name##_add_hash(hll_t *hll, hll_hash_t hash)       \
+  {                                                                     \
+    unsigned int idx =                                                  \
+      (unsigned int)(hash >> (sizeof(hll_hash_t) * 8                    \
+                              - (fixed_precision)));                    \
+    unsigned int rank = _HLL_HASH_ZEROS(hash, fixed_precision) + 1;     \
+    if (rank > hll->_registers[idx])                                    \
+      hll->_registers[idx] = (unsigned char)rank;                       \
+  }                                                                     \
+                                                                        \
+  static inline hll_error name##_add(hll_t *hll,                        \
+                                     hll_element_t element,             \
+                                     unsigned int element_len)          \
+  {                                                                     \
+    name##_add_hash(hll, (hash_func)(element, element_len));            \
+    return HLL_OK;                                                      \
+  }                                                                     \
+                                                                        \
+  static inline long long name##_count(hll_t *hll)                      \
+  {                                                                     \
+    double sum;                                                         \
+    unsigned int zeros;                                                 \
+    _hll_registers_sum(hll, &sum, &zeros);                              \
+    return _hll_estimate(fixed_precision, sum, zeros);                  \
+  }
+
+//
+// Implementation
+//
+
+#ifdef HLL_IMPLEMENTATION
+
+#ifndef HLL_NO_SIMD
+  #if defined(__AVX2__)
+    #include <immintrin.h>
+    #define _HLL_AVX2
+  #endif
+  #if defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define _HLL_SSE2
+  #endif
+  #if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define _HLL_NEON
+  #endif
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+  #include <intrin.h>
+#endif
+
+#include <string.h>
+
+// Little endian reads, compilers turn these in a single load
+#define _HLL_READ32(p)                                                \
+  ((uint32_t)(p)[0] | ((uint32_t)(p)[1] << 8)                         \
+   | ((uint32_t)(p)[2] << 16) | ((uint32_t)(p)[3] << 24))
+#define _HLL_READ64(p) \
+  ((uint64_t)_HLL_READ32(p) | ((uint64_t)_HLL_READ32((p) + 4) << 32))
+
+// Hash an element for an hll or a sliding window hll, see
+// HLL_HASH_INLINE
+#ifdef HLL_HASH_INLINE
+  #define _HLL_HASH(hll, element, element_len) \
+    HLL_HASH_FUNC(element, element_len)
+#else
+  #define _HLL_HASH(hll, element, element_len) \
+    (hll)->hash(element, element_len)
+#endif
+
+#ifdef HLL_STATS
+  #define _HLL_STAT_ADD(hll, counter, n) \
+    _hll_stat_add(&(hll)->stats.counter, (n), (hll)->concurrent)
+  #define _HLL_HOOK(hll, hook, ...)                                   \
+    do {                                                              \
+      if ((hll)->hooks != NULL && (hll)->hooks->hook != NULL)         \
+        (hll)->hooks->hook((hll)->hooks->ctx, (hll), __VA_ARGS__);    \
+    } while (0)
+#else
+  #define _HLL_STAT_ADD(hll, counter, n) ((void)(n))
+  #define _HLL_HOOK(hll, hook, ...) ((void)0)
+#endif
+
+#define _HLL_WRITE32(p, v) do {                                       \
+    (p)[0] = (unsigned char)((v) & 0xFF);                             \
+    (p)[1] = (unsigned char)(((v) >> 8) & 0xFF);                      \
+    (p)[2] = (unsigned char)(((v) >> 16) & 0xFF);                     \
+    (p)[3] = (unsigned char)(((v) >> 24) & 0xFF);                     \
+  } while (0)
+
+#ifdef HLL_STATS
+// Add [n] to a counter of an hll, atomically if it is concurrent
+HLL_DEF void _hll_stat_add(unsigned long long *counter,
+                           unsigned long long n,
+                           int atomic)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  if (atomic)
+  {
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+    return;
+  }
+#elif defined(_MSC_VER)
+  if (atomic)
+  {
+    _InterlockedExchangeAdd64((volatile __int64*)counter, (__int64)n);
+    return;
+  }
+#endif
+  *counter += n;
+}
+#endif
+
+// Allocate memory for an hll with its allocator, like calloc(3)
+HLL_DEF void *_hll_calloc(const hll_t *hll, size_t count, size_t size)
+{
+  if (hll->allocator != NULL)
+    return hll->allocator->calloc(hll->allocator->ctx, count, size);
+  return HLL_CALLOC(count, size);
+}
+
+// Free memory allocated with _hll_calloc
+HLL_DEF void _hll_free(const hll_t *hll, void *ptr)
+{
+  if (hll->allocator != NULL)
+    hll->allocator->free(hll->allocator->ctx, ptr);
+  else
+    HLL_FREE(ptr);
+}
+
+// Biggest precision whose registers of [register_bits] fit in
+// [budget] bytes, or 0 if none does
+HLL_DEF unsigned int _hll_budget_precision(size_t budget,
+                                           unsigned int register_bits)
+{
+  unsigned int precision = HLL_PRECISION_MAX;
+  while (precision >= HLL_PRECISION_MIN
+         && HLL_REGISTERS_SIZE(precision, register_bits) > budget)
+    precision--;
+  return (precision >= HLL_PRECISION_MIN) ? precision : 0;
+}
+
+// Set the precision, and the register bits if not set, from the
+// target_error and memory_budget of hll
+HLL_DEF hll_error _hll_auto_precision(hll_t *hll)
+{
+  if (!(hll->target_error >= 0))
+    return HLL_ERROR_INVALID_PRECISION;
+
+  unsigned int precision = HLL_PRECISION_MAX;
+  if (hll->target_error > 0)
+  {
+    // 1.04 / sqrt(2^precision) <= target_error
+    const double registers = 1.0816 / (hll->target_error * hll->target_error);
+    precision = HLL_PRECISION_MIN;
+    while (precision <= HLL_PRECISION_MAX
+           && (double)(1u << precision) < registers)
+      precision++;
+    if (precision > HLL_PRECISION_MAX)
+      return HLL_ERROR_INVALID_PRECISION;
+  }
+
+  if (hll->memory_budget > 0)
+  {
+    unsigned int bits = hll->register_bits;
+    if (bits == 0)
+      bits = hll->concurrent ? 8 : HLL_REGISTER_BITS;
+    unsigned int fit = _hll_budget_precision(hll->memory_budget, bits);
+
+    // Packed registers when they allow the precision the hll needs
+    if (hll->register_bits == 0 && !hll->concurrent && bits == 8
+        && fit < precision)
+    {
+      unsigned int fit_packed = _hll_budget_precision(hll->memory_budget, 6);
+      if (fit_packed > fit)
+      {
+        bits = 6;
+        fit  = fit_packed;
+      }
+    }
+    if (fit == 0)
+      return HLL_ERROR_INVALID_PRECISION;
+
+    if (precision > fit)
+      precision = fit;
+    if (hll->register_bits == 0 && bits != HLL_REGISTER_BITS)
+      hll->register_bits = bits;
+  }
+
+  hll->precision = precision;
+  return HLL_OK;
+}
+
+// _hll_init_settings without the cleanup on errors
+HLL_DEF hll_error _hll_check_settings(hll_t *hll)
+{
+  hll_error err;
+  if ((hll->target_error != 0 || hll->memory_budget != 0)
+      && (err = _hll_auto_precision(hll)) != HLL_OK)
+    return err;
+
+  if (hll->precision < HLL_PRECISION_MIN
+      || hll->precision > HLL_PRECISION_MAX)
+    return HLL_ERROR_INVALID_PRECISION;
+
+  if (hll->concurrent && hll->cached)
+    return HLL_ERROR_UNSUPPORTED;
+
+  if (hll->concurrent)
+  {
+#if !defined(__GNUC__) && !defined(__clang__) && !defined(_MSC_VER)
+    return HLL_ERROR_UNSUPPORTED;
+#endif
+    if (hll->register_bits == 0)
+      hll->register_bits = 8;
+    if (hll->representation == 0)
+      hll->representation = HLL_REPRESENTATION_DENSE;
+    if (hll->register_bits != 8)
+      return HLL_ERROR_INVALID_REGISTER_BITS;
+    if (hll->representation != HLL_REPRESENTATION_DENSE)
+      return HLL_ERROR_INVALID_REPRESENTATION;
+  }
+
+  if (hll->track_changes)
+  {
+    if (hll->concurrent)
+      return HLL_ERROR_UNSUPPORTED;
+    if (hll->representation == 0)
+      hll->representation = HLL_REPRESENTATION_DENSE;
+    if (hll->representation != HLL_REPRESENTATION_DENSE)
+      return HLL_ERROR_INVALID_REPRESENTATION;
+  }
+
+  if (hll->register_bits == 0)
+    hll->register_bits = HLL_REGISTER_BITS;
+  if (hll->register_bits != 6 && hll->register_bits != 8)
+    return HLL_ERROR_INVALID_REGISTER_BITS;
+
+  if (hll->representation == 0)
+    hll->representation = HLL_REPRESENTATION;
+  if (hll->representation != HLL_REPRESENTATION_DENSE
+      && hll->representation != HLL_REPRESENTATION_SPARSE)
+    return HLL_ERROR_INVALID_REPRESENTATION;
+
+  if (hll->estimator == 0)
+    hll->estimator = HLL_ESTIMATOR;
+  if (hll->estimator != HLL_ESTIMATOR_HLLPP
+      && hll->estimator != HLL_ESTIMATOR_ERTL)
+    return HLL_ERROR_INVALID_ESTIMATOR;
+
+  // The sparse representation does not pay off if the insertion
+  // buffer alone is as big as the registers
+  if (hll->representation == HLL_REPRESENTATION_SPARSE
+      && HLL_SPARSE_BUFFER_LEN * sizeof(uint32_t)
+         >= HLL_REGISTERS_SIZE(hll->precision, hll->register_bits))
+    hll->representation = HLL_REPRESENTATION_DENSE;
+
+  hll->_registers = NULL;
+  hll->_changes = NULL;
+  hll->_sparse = (hll_sparse_t){0};
+  hll->_flags = 0;
+  hll->_sum   = (double)(1u << hll->precision);
+  hll->_zeros = 1u << hll->precision;
+  hll->_count = 0;
+#ifdef HLL_STATS
+  hll->stats = (hll_stats_t){0};
+#endif
+
+  return HLL_OK;
+}
+
+// Check and complete the settings of an hll, and reset its state. On
+// errors the representation is reset to 0, so that the hll reads as
+// uninitialized.
+HLL_DEF hll_error _hll_init_settings(hll_t *hll)
+{
+  hll_error err = _hll_check_settings(hll);
+  if (err != HLL_OK)
+    hll->representation = 0;
+  return err;
+}
+
+HLL_DEF hll_error _hll_init_impl(hll_t *hll, hll_t *hll_src)
+{
+  if (hll == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (hll_src != NULL)
+    *hll = *hll_src;
+
+  hll_error err = _hll_init_settings(hll);
+  if (err != HLL_OK)
+    return err;
+  if (hll->representation == HLL_REPRESENTATION_SPARSE)
+    return HLL_OK;
+  
+  hll->_registers = _hll_calloc(hll, HLL_REGISTERS_SIZE(hll->precision,
+                                                        hll->register_bits), 1);
+  if (hll->_registers == NULL)
+  {
+    hll->representation = 0;
+    return HLL_ERROR_ALLOCATING_MEMORY;
+  }
+
+  if (hll->track_changes)
+  {
+    hll->_changes = _hll_calloc(hll, _HLL_CHANGES_SIZE(hll->precision), 1);
+    if (hll->_changes == NULL)
+    {
+      _hll_free(hll, hll->_registers);
+      hll->_registers = NULL;
+      hll->representation = 0;
+      return HLL_ERROR_ALLOCATING_MEMORY;
+    }
+  }
+  
+  return HLL_OK;
+}
+
+HLL_DEF hll_error _hll_init_memory_impl(hll_t *hll,
+                                        void *memory,
+                                        size_t memory_len,
+                                        hll_t *hll_src)
+{
+  if (hll == NULL)
+    return HLL_ERROR_HLL_NULL;
+  if (memory == NULL || hll_src == NULL)
+  {
+    hll->representation = 0;
+    return HLL_ERROR_HLL_NULL;
+  }
+
+  // The sparse representation would need to grow
+  *hll = *hll_src;
+  hll->representation = HLL_REPRESENTATION_DENSE;
+  hll_error err = _hll_init_settings(hll);
+  if (err != HLL_OK)
+    return err;
+
+  if (hll->track_changes)
+  {
+    hll->representation = 0;
+    return HLL_ERROR_UNSUPPORTED;
+  }
+
+  size_t size = HLL_REGISTERS_SIZE(hll->precision, hll->register_bits);
+  if (memory_len < size)
+  {
+    hll->representation = 0;
+    return HLL_ERROR_BUFFER_TOO_SMALL;
+  }
+
+  memset(memory, 0, size);
+  hll->_registers = memory;
+  hll->_flags = _HLL_FLAG_BORROWED;
+
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_init2(hll_t *hll,
+                   unsigned int precision)
+{
+  return _hll_init_impl(hll, &(hll_t){.precision = precision});
+}
+
+HLL_DEF hll_error hll_destroy(hll_t *hll)
+{
+  if (hll == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (hll->representation == 0)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  if (!(hll->_flags & _HLL_FLAG_BORROWED))
+  {
+    if (hll->_registers != NULL)
+      _hll_free(hll, hll->_registers);
+    if (hll->_sparse.list != NULL)
+      _hll_free(hll, hll->_sparse.list);
+  }
+  if (hll->_sparse.buffer != NULL)
+    _hll_free(hll, hll->_sparse.buffer);
+  if (hll->_changes != NULL)
+    _hll_free(hll, hll->_changes);
+
+  hll->_registers = NULL;
+  hll->_changes = NULL;
+  hll->_sparse = (hll_sparse_t){0};
+  hll->representation = 0;
+  hll->_flags = 0;
+  
+  return HLL_OK;
+}
+
+HLL_DEF hll_hash_t hll_max(hll_hash_t a, hll_hash_t b)
+{
+  return (a > b) ? a : b;
+}
+
+HLL_DEF unsigned int hll_get_register(const hll_t *hll, unsigned int idx)
+{
+  if (hll->register_bits == 8)
+    return hll->_registers[idx];
+
+  // Four 6 bit registers are packed in three bytes
+  const unsigned char *group = hll->_registers + 3 * (idx >> 2);
+  unsigned long word = (unsigned long)group[0]
+    | ((unsigned long)group[1] << 8)
+    | ((unsigned long)group[2] << 16);
+  return (word >> (6 * (idx & 3))) & 0x3F;
+}
+
+// Write a register without updating the cached sum
+HLL_DEF void _hll_register_write(hll_t *hll,
+                                 unsigned int idx,
+                                 unsigned int value)
+{
+  if (value > HLL_REGISTER_MAX)
+    value = HLL_REGISTER_MAX;
+
+  if (hll->_changes != NULL)
+    hll->_changes[idx >> 3] |= (unsigned char)(1u << (idx & 7));
+
+  if (hll->register_bits == 8)
+  {
+    hll->_registers[idx] = (unsigned char)value;
+    return;
+  }
+
+  unsigned char *group = hll->_registers + 3 * (idx >> 2);
+  unsigned int shift   = 6 * (idx & 3);
+  unsigned long word = (unsigned long)group[0]
+    | ((unsigned long)group[1] << 8)
+    | ((unsigned long)group[2] << 16);
+  word = (word & ~(0x3FUL << shift)) | ((unsigned long)value << shift);
+  group[0] = (unsigned char)(word & 0xFF);
+  group[1] = (unsigned char)((word >> 8) & 0xFF);
+  group[2] = (unsigned char)((word >> 16) & 0xFF);
+}
+
+HLL_DEF void hll_set_register(hll_t *hll,
+                              unsigned int idx,
+                              unsigned int value)
+{
+  _hll_register_write(hll, idx, value);
+  if (hll->cached)
+    hll->_flags |= _HLL_FLAG_DIRTY | _HLL_FLAG_SUM_STALE;
+}
+
+// _hll_inverse_powers[k] = 2^-k, for every possible register value
+#define _HLL_INVERSE_POWER(k) (1.0 / (double)(1ULL << (k)))
+#define _HLL_INVERSE_POWERS_8(k)                                    \
+  _HLL_INVERSE_POWER(k),     _HLL_INVERSE_POWER(k + 1),             \
+  _HLL_INVERSE_POWER(k + 2), _HLL_INVERSE_POWER(k + 3),             \
+  _HLL_INVERSE_POWER(k + 4), _HLL_INVERSE_POWER(k + 5),             \
+  _HLL_INVERSE_POWER(k + 6), _HLL_INVERSE_POWER(k + 7)
+static const double _hll_inverse_powers[64] = {
+  _HLL_INVERSE_POWERS_8(0),  _HLL_INVERSE_POWERS_8(8),
+  _HLL_INVERSE_POWERS_8(16), _HLL_INVERSE_POWERS_8(24),
+  _HLL_INVERSE_POWERS_8(32), _HLL_INVERSE_POWERS_8(40),
+  _HLL_INVERSE_POWERS_8(48), _HLL_INVERSE_POWERS_8(56),
+};
+
+// Atomically set [*reg] to the maximum of [*reg] and [value]. The
+// common case of a value not bigger than the register only reads it.
+// Returns 1 if the register was raised, 0 otherwise.
+HLL_DEF unsigned int _hll_register_max_atomic(unsigned char *reg,
+                                              unsigned int value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  unsigned char current = __atomic_load_n(reg, __ATOMIC_RELAXED);
+  while (current < value)
+    if (__atomic_compare_exchange_n(reg, &current, (unsigned char)value,
+                                    1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      return 1;
+#elif defined(_MSC_VER)
+  char current = *(volatile char*)reg;
+  while ((unsigned char)current < value)
+  {
+    char prev = _InterlockedCompareExchange8((volatile char*)reg,
+                                             (char)value, current);
+    if (prev == current)
+      return 1;
+    current = prev;
+  }
+#else
+  (void)reg;
+  (void)value;
+#endif
+  return 0;
+}
+
+// Read a register of [hll], with a relaxed atomic load if the hll is
+// concurrent so that readers do not race with the writers
+HLL_DEF unsigned int _hll_register_read(const hll_t *hll, unsigned int idx)
+{
+  if (!hll->concurrent)
+    return hll_get_register(hll, idx);
+#if defined(__GNUC__) || defined(__clang__)
+  return __atomic_load_n(hll->_registers + idx, __ATOMIC_RELAXED);
+#else
+  return *(volatile const unsigned char*)(hll->_registers + idx);
+#endif
+}
+
+// Set a register to [rank] if it is bigger than its current value.
+// Returns 1 if the register was raised, 0 otherwise.
+HLL_DEF unsigned int _hll_register_update(hll_t *hll,
+                                          unsigned int idx,
+                                          unsigned int rank)
+{
+  if (hll->concurrent)
+    return _hll_register_max_atomic(hll->_registers + idx,
+                                    rank > HLL_REGISTER_MAX
+                                    ? HLL_REGISTER_MAX : rank);
+
+  unsigned int old = hll_get_register(hll, idx);
+  if (rank <= old)
+    return 0;
+
+  if (rank > HLL_REGISTER_MAX)
+    rank = HLL_REGISTER_MAX;
+  if (hll->cached)
+  {
+    hll->_sum   += _hll_inverse_powers[rank] - _hll_inverse_powers[old];
+    hll->_zeros -= (old == 0);
+    hll->_flags |= _HLL_FLAG_DIRTY;
+  }
+  _hll_register_write(hll, idx, rank);
+  return 1;
+}
+
+// Number of leading zeros of a non zero 32 bit value
+HLL_DEF unsigned int _hll_clz32(uint32_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return (unsigned int)__builtin_clz(x);
+#elif defined(_MSC_VER)
+  unsigned long idx;
+  _BitScanReverse(&idx, x);
+  return 31 - (unsigned int)idx;
+#else
+  unsigned int count = 0;
+  if (!(x & 0xFFFF0000u)) { count += 16; x <<= 16; }
+  if (!(x & 0xFF000000u)) { count += 8;  x <<= 8;  }
+  if (!(x & 0xF0000000u)) { count += 4;  x <<= 4;  }
+  if (!(x & 0xC0000000u)) { count += 2;  x <<= 2;  }
+  if (!(x & 0x80000000u)) { count += 1; }
+  return count;
+#endif
+}
+
+// Number of leading zeros of a non zero 64 bit value
+HLL_DEF unsigned int _hll_clz64(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return (unsigned int)__builtin_clzll(x);
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long idx;
+  _BitScanReverse64(&idx, x);
+  return 63 - (unsigned int)idx;
+#else
+  uint32_t high = (uint32_t)(x >> 32);
+  return high ? _hll_clz32(high) : 32 + _hll_clz32((uint32_t)x);
+#endif
+}
+
+// Number of leading zeros of [hash] after its first [precision] bits
+//
+// The bit right after the tail is set as a sentinel, so the count
+// never exceeds the tail length and the clz input is never zero.
+// With GCC and Clang the count compiles to a single lzcnt or bsr.
+HLL_DEF unsigned int
+hll_get_hash_zeros(hll_hash_t hash, unsigned int precision)
+{
+  hll_hash_t tail = (hll_hash_t)(hash << precision)
+    | ((hll_hash_t)1 << (precision - 1));
+  if (sizeof(hll_hash_t) > 4)
+    return _hll_clz64((uint64_t)tail);
+  return _hll_clz32((uint32_t)tail);
+}
+
+// Encode an hash in a sparse entry, see hll_sparse_t
+HLL_DEF uint32_t _hll_sparse_encode(hll_hash_t hash, unsigned int precision)
+{
+  const unsigned int hash_bits = sizeof(hll_hash_t)*8;
+  uint32_t sparse_idx = (uint32_t)(hash >> (hash_bits - HLL_SPARSE_PRECISION));
+  uint32_t extra_mask = (1u << (HLL_SPARSE_PRECISION - precision)) - 1;
+  if ((sparse_idx & extra_mask) != 0)
+    return sparse_idx << 7;
+
+  uint32_t rank = hll_get_hash_zeros(hash, HLL_SPARSE_PRECISION) + 1;
+  return (sparse_idx << 7) | (rank << 1) | 1;
+}
+
+// Decode a sparse entry in the register index and value of an hll
+// with [precision] bits of precision
+HLL_DEF void _hll_sparse_decode(uint32_t entry,
+                                unsigned int precision,
+                                unsigned int *idx,
+                                unsigned int *rank)
+{
+  const unsigned int extra_bits = HLL_SPARSE_PRECISION - precision;
+  uint32_t sparse_idx = entry >> 7;
+  *idx = sparse_idx >> extra_bits;
+  if ((sparse_idx & ((1u << extra_bits) - 1)) == 0)
+  {
+    *rank = extra_bits + ((entry >> 1) & 0x3F);
+    return;
+  }
+
+  // The rank is given by the leading zeros of the extra index bits
+  unsigned int zeros = 0;
+  while (!(sparse_idx & (1u << (extra_bits - zeros - 1))))
+    zeros++;
+  *rank = zeros + 1;
+}
+
+// Read the varint at [*pos] in [list] and advance [*pos]
+HLL_DEF uint32_t _hll_varint_read(const unsigned char *list,
+                                  unsigned int *pos)
+{
+  uint32_t value = 0;
+  unsigned int shift = 0;
+  unsigned char byte;
+  do {
+    byte = list[(*pos)++];
+    value |= (uint32_t)(byte & 0x7F) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  return value;
+}
+
+// Write [value] as a varint at [*pos] in [list] and advance [*pos]
+HLL_DEF void _hll_varint_write(unsigned char *list,
+                               unsigned int *pos,
+                               uint32_t value)
+{
+  while (value >= 0x80)
+  {
+    list[(*pos)++] = (unsigned char)((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  list[(*pos)++] = (unsigned char)value;
+}
+
+// Sort the sparse insertion buffer with shellsort
+HLL_DEF void _hll_sparse_sort(uint32_t *buffer, unsigned int len)
+{
+  static const unsigned int gaps[] = { 57, 23, 10, 4, 1 };
+  for (unsigned int g = 0; g < sizeof(gaps) / sizeof(gaps[0]); ++g)
+  {
+    unsigned int gap = gaps[g];
+    for (unsigned int i = gap; i < len; ++i)
+    {
+      uint32_t tmp = buffer[i];
+      unsigned int j = i;
+      for (; j >= gap && buffer[j - gap] > tmp; j -= gap)
+        buffer[j] = buffer[j - gap];
+      buffer[j] = tmp;
+    }
+  }
+}
+
+// Convert a sparse hll to the dense representation
+HLL_DEF hll_error _hll_sparse_to_dense(hll_t *hll)
+{
+  hll->_registers = _hll_calloc(hll, HLL_REGISTERS_SIZE(hll->precision,
+                                                        hll->register_bits), 1);
+  if (hll->_registers == NULL)
+    return HLL_ERROR_ALLOCATING_MEMORY;
+
+  unsigned int idx, rank;
+  unsigned int pos = 0;
+  uint32_t entry = 0;
+  for (unsigned int i = 0; i < hll->_sparse.list_count; ++i)
+  {
+    entry += _hll_varint_read(hll->_sparse.list, &pos);
+    _hll_sparse_decode(entry, hll->precision, &idx, &rank);
+    _hll_register_update(hll, idx, rank);
+  }
+  // Buffered entries were not counted as updates yet
+  unsigned int updates = 0;
+  for (unsigned int i = 0; i < hll->_sparse.buffer_len; ++i)
+  {
+    _hll_sparse_decode(hll->_sparse.buffer[i], hll->precision, &idx, &rank);
+    updates += _hll_register_update(hll, idx, rank);
+  }
+  _HLL_STAT_ADD(hll, register_updates, updates);
+  _HLL_STAT_ADD(hll, sparse_to_dense, 1);
+
+  if (hll->_sparse.list != NULL && !(hll->_flags & _HLL_FLAG_BORROWED))
+    _hll_free(hll, hll->_sparse.list);
+  if (hll->_sparse.buffer != NULL)
+    _hll_free(hll, hll->_sparse.buffer);
+  hll->_sparse = (hll_sparse_t){0};
+  hll->representation = HLL_REPRESENTATION_DENSE;
+  hll->_flags &= ~(unsigned int)_HLL_FLAG_BORROWED;
+
+  return HLL_OK;
+}
+
+// Merge the insertion buffer in the sorted sparse list, and convert
+// the hll to the dense representation if the list got bigger than
+// the registers
+HLL_DEF hll_error _hll_sparse_flush(hll_t *hll)
+{
+  hll_sparse_t *sparse = &hll->_sparse;
+  if (sparse->buffer_len == 0)
+    return HLL_OK;
+
+  _hll_sparse_sort(sparse->buffer, sparse->buffer_len);
+
+  // Each varint takes at most 5 bytes
+  unsigned int cap = sparse->list_len + sparse->buffer_len * 5;
+  unsigned char *list = _hll_calloc(hll, cap, 1);
+  if (list == NULL)
+    return HLL_ERROR_ALLOCATING_MEMORY;
+
+  unsigned int len = 0, count = 0, pos = 0, b = 0, l = 0, updates = 0;
+  // [pending_list] is the entry of the list with the index of
+  // [pending], or 0 if there is none
+  uint32_t list_entry = 0, pending = 0, pending_list = 0, last = 0;
+  if (sparse->list_count > 0)
+    list_entry = _hll_varint_read(sparse->list, &pos);
+  while (l < sparse->list_count || b < sparse->buffer_len)
+  {
+    uint32_t entry, from_list = 0;
+    if (b == sparse->buffer_len
+        || (l < sparse->list_count && list_entry <= sparse->buffer[b]))
+    {
+      entry = from_list = list_entry;
+      if (++l < sparse->list_count)
+        list_entry += _hll_varint_read(sparse->list, &pos);
+    } else {
+      entry = sparse->buffer[b++];
+    }
+
+    // Entries with the same index are sorted by rank, keep the last
+    if (count > 0 && (entry >> 7) == (pending >> 7))
+    {
+      pending = entry;
+      if (from_list)
+        pending_list = from_list;
+      continue;
+    }
+    if (count > 0)
+    {
+      _hll_varint_write(list, &len, pending - last);
+      updates += (pending != pending_list);
+      last = pending;
+    }
+    pending = entry;
+    pending_list = from_list;
+    count++;
+  }
+  if (count > 0)
+  {
+    _hll_varint_write(list, &len, pending - last);
+    updates += (pending != pending_list);
+  }
+  _HLL_STAT_ADD(hll, register_updates, updates);
+
+  if (sparse->list != NULL && !(hll->_flags & _HLL_FLAG_BORROWED))
+    _hll_free(hll, sparse->list);
+  hll->_flags &= ~(unsigned int)_HLL_FLAG_BORROWED;
+  sparse->list       = list;
+  sparse->list_len   = len;
+  sparse->list_count = count;
+  sparse->buffer_len = 0;
+
+  if (len + HLL_SPARSE_BUFFER_LEN * sizeof(uint32_t)
+      > HLL_REGISTERS_SIZE(hll->precision, hll->register_bits))
+    return _hll_sparse_to_dense(hll);
+
+  return HLL_OK;
+}
+
+// Insert a sparse entry in an hll with a precision not higher than
+// the one of the entry
+HLL_DEF hll_error _hll_sparse_add_entry(hll_t *hll, uint32_t entry)
+{
+  if (hll->representation == HLL_REPRESENTATION_DENSE)
+  {
+    unsigned int idx, rank;
+    _hll_sparse_decode(entry, hll->precision, &idx, &rank);
+    _hll_register_update(hll, idx, rank);
+    return HLL_OK;
+  }
+
+  // The rank is not needed if the extra index bits are not zero
+  uint32_t extra_mask = (1u << (HLL_SPARSE_PRECISION - hll->precision)) - 1;
+  if ((entry >> 7) & extra_mask)
+    entry &= ~(uint32_t)0x7F;
+
+  hll_sparse_t *sparse = &hll->_sparse;
+  if (sparse->buffer == NULL)
+  {
+    sparse->buffer = _hll_calloc(hll, HLL_SPARSE_BUFFER_LEN,
+                                 sizeof(uint32_t));
+    if (sparse->buffer == NULL)
+      return HLL_ERROR_ALLOCATING_MEMORY;
+  }
+
+  sparse->buffer[sparse->buffer_len++] = entry;
+  hll->_flags |= _HLL_FLAG_DIRTY;
+  if (sparse->buffer_len == HLL_SPARSE_BUFFER_LEN)
+    return _hll_sparse_flush(hll);
+
+  return HLL_OK;
+}
+
+// Insert an hash in a dense hll. Returns 1 if a register was raised,
+// 0 otherwise.
+HLL_DEF unsigned int _hll_dense_add_hash(hll_t *hll, hll_hash_t hash)
+{
+  // Read the paper to understand what is happening
+  _HLL_STAT_ADD(hll, inserts, 1);
+  unsigned int offset    = sizeof(hll_hash_t)*8 - hll->precision;
+  hll_hash_t idx         = hash >> offset;
+  hll_hash_t hash_zeros  = hll_get_hash_zeros(hash, hll->precision);
+  unsigned int updated   = _hll_register_update(hll, idx, hash_zeros + 1);
+  _HLL_STAT_ADD(hll, register_updates, updated);
+
+  return updated;
+}
+
+// Insert an hash in an initialized hll
+HLL_DEF hll_error _hll_add_hash(hll_t *hll, hll_hash_t hash)
+{
+  if (hll->representation == HLL_REPRESENTATION_SPARSE)
+  {
+    _HLL_STAT_ADD(hll, inserts, 1);
+    return _hll_sparse_add_entry(hll, _hll_sparse_encode(hash,
+                                                         hll->precision));
+  }
+
+  _hll_dense_add_hash(hll, hash);
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_add(hll_t *hll,
+                  hll_element_t element,
+                  unsigned int element_len)
+{
+  if (hll == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (hll->representation == 0)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  return _hll_add_hash(hll, _HLL_HASH(hll, element, element_len));
+}
+
+// Insert a batch of at most HLL_BATCH_LEN hashes in a dense hll.
+// Returns the number of raised registers.
+HLL_DEF unsigned int _hll_dense_add_hashes(hll_t *hll,
+                                           const hll_hash_t *hashes,
+                                           unsigned int n)
+{
+  const unsigned int offset = sizeof(hll_hash_t)*8 - hll->precision;
+  unsigned int idx[HLL_BATCH_LEN];
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    idx[i] = (unsigned int)(hashes[i] >> offset);
+    HLL_PREFETCH(hll->_registers + (hll->register_bits == 8
+                                    ? idx[i] : 3 * (idx[i] >> 2)));
+  }
+
+  unsigned int updates = 0;
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    unsigned int rank = hll_get_hash_zeros(hashes[i], hll->precision) + 1;
+    updates += _hll_register_update(hll, idx[i], rank);
+  }
+  _HLL_STAT_ADD(hll, inserts, n);
+  _HLL_STAT_ADD(hll, register_updates, updates);
+
+  return updates;
+}
+
+// Insert a batch of at most HLL_BATCH_LEN hashes
+HLL_DEF hll_error _hll_add_hashes(hll_t *hll,
+                                  const hll_hash_t *hashes,
+                                  unsigned int n)
+{
+  hll_error err;
+  if (hll->representation == HLL_REPRESENTATION_SPARSE)
+  {
+    for (unsigned int i = 0; i < n; ++i)
+      if ((err = _hll_add_hash(hll, hashes[i])) != HLL_OK)
+        return err;
+    return HLL_OK;
+  }
+
+  _hll_dense_add_hashes(hll, hashes, n);
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_add_hash(hll_t *hll, hll_hash_t hash)
+{
+  if (hll == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (hll->representation == 0)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  return _hll_add_hash(hll, hash);
+}
+
+HLL_DEF hll_error hll_add_hashes(hll_t *hll,
+                                 const hll_hash_t *hashes,
+                                 unsigned int n)
+{
+  if (hll == NULL || (n > 0 && hashes == NULL))
+    return HLL_ERROR_HLL_NULL;
+
+  if (hll->representation == 0)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  hll_error err;
+  for (unsigned int i = 0; i < n; i += HLL_BATCH_LEN)
+  {
+    unsigned int len = (n - i < HLL_BATCH_LEN) ? n - i : HLL_BATCH_LEN;
+    if ((err = _hll_add_hashes(hll, hashes + i, len)) != HLL_OK)
+      return err;
+  }
+
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_add_many(hll_t *hll,
+                               const hll_element_t *elements,
+                               const unsigned int *lengths,
+                               unsigned int n)
+{
+  if (hll == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (hll->representation == 0)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  hll_error err;
+  hll_hash_t hashes[HLL_BATCH_LEN];
+  for (unsigned int i = 0; i < n; i += HLL_BATCH_LEN)
+  {
+    unsigned int len = (n - i < HLL_BATCH_LEN) ? n - i : HLL_BATCH_LEN;
+    for (unsigned int j = 0; j < len; ++j)
+      hashes[j] = _HLL_HASH(hll, elements[i + j], lengths[i + j]);
+    if ((err = _hll_add_hashes(hll, hashes, len)) != HLL_OK)
+      return err;
+  }
+
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_add_many_fixed(hll_t *hll,
+                                     const hll_element_t *elements,
+                                     unsigned int element_len,
+                                     unsigned int n)
+{
+  if (hll == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (hll->representation == 0)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  hll_error err;
+  hll_hash_t hashes[HLL_BATCH_LEN];
+  for (unsigned int i = 0; i < n; i += HLL_BATCH_LEN)
+  {
+    unsigned int len = (n - i < HLL_BATCH_LEN) ? n - i : HLL_BATCH_LEN;
+    for (unsigned int j = 0; j < len; ++j)
+      hashes[j] = _HLL_HASH(hll, elements[i + j], element_len);
+    if ((err = _hll_add_hashes(hll, hashes, len)) != HLL_OK)
+      return err;
+  }
+
+  return HLL_OK;
+}
+
+// Number of registers summed in single precision by the vector
+// paths before accumulating the partial sums in double precision.
+// Must be less than 255 vectors, so that the per-byte zero counters
+// do not overflow.
+#define _HLL_SUM_CHUNK 1024
+
+// Compute in a single pass the harmonic sum of 2^-register and the
+// number of zero registers of a dense hll
+//
+// The vector paths build 2^-k directly as the float with exponent
+// 127 - k, the scalar path reads it from _hll_inverse_powers.
+HLL_DEF void _hll_registers_sum(const hll_t *hll,
+                                double *sum,
+                                unsigned int *zeros)
+{
+  const unsigned int registers_len = 1u << hll->precision;
+  const unsigned char *registers = hll->_registers;
+  double total = 0.0;
+  unsigned int zero_count = 0;
+  unsigned int i = 0;
+
+  if (hll->register_bits == 6)
+  {
+    for (; i < registers_len; i += 4)
+    {
+      const unsigned char *group = registers + 3 * (i >> 2);
+      unsigned long word = (unsigned long)group[0]
+        | ((unsigned long)group[1] << 8)
+        | ((unsigned long)group[2] << 16);
+      for (unsigned int j = 0; j < 4; ++j)
+      {
+        unsigned int reg = (word >> (6 * j)) & 0x3F;
+        total += _hll_inverse_powers[reg];
+        zero_count += (reg == 0);
+      }
+    }
+    *sum = total;
+    *zeros = zero_count;
+    return;
+  }
+
+#if defined(_HLL_AVX2)
+  {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i bias = _mm256_set1_epi32(127);
+    float partial[8];
+    while (i + 32 <= registers_len)
+    {
+      unsigned int end = i + _HLL_SUM_CHUNK;
+      if (end > registers_len)
+        end = registers_len;
+      // Independent accumulators, so that the additions do not wait
+      // for each other
+      __m256 acc[4] = { _mm256_setzero_ps(), _mm256_setzero_ps(),
+                        _mm256_setzero_ps(), _mm256_setzero_ps() };
+      __m256i zacc = _mm256_setzero_si256();
+      for (; i + 32 <= end; i += 32)
+      {
+        __m256i regs = _mm256_loadu_si256((const __m256i*)(registers + i));
+        zacc = _mm256_sub_epi8(zacc, _mm256_cmpeq_epi8(regs, zero));
+        __m128i halves[2] = { _mm256_castsi256_si128(regs),
+                              _mm256_extracti128_si256(regs, 1) };
+        for (unsigned int h = 0; h < 2; ++h)
+        {
+          __m256i lo = _mm256_cvtepu8_epi32(halves[h]);
+          __m256i hi = _mm256_cvtepu8_epi32(_mm_srli_si128(halves[h], 8));
+          lo = _mm256_slli_epi32(_mm256_sub_epi32(bias, lo), 23);
+          hi = _mm256_slli_epi32(_mm256_sub_epi32(bias, hi), 23);
+          acc[2 * h] = _mm256_add_ps(acc[2 * h], _mm256_castsi256_ps(lo));
+          acc[2 * h + 1] = _mm256_add_ps(acc[2 * h + 1],
+                                         _mm256_castsi256_ps(hi));
+        }
+      }
+      _mm256_storeu_ps(partial, _mm256_add_ps(_mm256_add_ps(acc[0], acc[1]),
+                                              _mm256_add_ps(acc[2], acc[3])));
+      for (unsigned int j = 0; j < 8; ++j)
+        total += partial[j];
+      __m256i zsum = _mm256_sad_epu8(zacc, zero);
+      __m128i zsum2 = _mm_add_epi64(_mm256_castsi256_si128(zsum),
+                                    _mm256_extracti128_si256(zsum, 1));
+      zero_count += (unsigned int)(_mm_cvtsi128_si32(zsum2)
+                                   + _mm_cvtsi128_si32(_mm_srli_si128(zsum2, 8)));
+    }
+  }
+#endif
+
+#if defined(_HLL_SSE2)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi32(127);
+    float partial[4];
+    while (i + 16 <= registers_len)
+    {
+      unsigned int end = i + _HLL_SUM_CHUNK;
+      if (end > registers_len)
+        end = registers_len;
+      // Independent accumulators, so that the additions do not wait
+      // for each other
+      __m128 acc[4] = { _mm_setzero_ps(), _mm_setzero_ps(),
+                        _mm_setzero_ps(), _mm_setzero_ps() };
+      __m128i zacc = _mm_setzero_si128();
+      for (; i + 16 <= end; i += 16)
+      {
+        __m128i regs = _mm_loadu_si128((const __m128i*)(registers + i));
+        zacc = _mm_sub_epi8(zacc, _mm_cmpeq_epi8(regs, zero));
+        __m128i words[2] = { _mm_unpacklo_epi8(regs, zero),
+                             _mm_unpackhi_epi8(regs, zero) };
+        for (unsigned int h = 0; h < 2; ++h)
+        {
+          __m128i lo = _mm_unpacklo_epi16(words[h], zero);
+          __m128i hi = _mm_unpackhi_epi16(words[h], zero);
+          lo = _mm_slli_epi32(_mm_sub_epi32(bias, lo), 23);
+          hi = _mm_slli_epi32(_mm_sub_epi32(bias, hi), 23);
+          acc[2 * h] = _mm_add_ps(acc[2 * h], _mm_castsi128_ps(lo));
+          acc[2 * h + 1] = _mm_add_ps(acc[2 * h + 1], _mm_castsi128_ps(hi));
+        }
+      }
+      _mm_storeu_ps(partial, _mm_add_ps(_mm_add_ps(acc[0], acc[1]),
+                                        _mm_add_ps(acc[2], acc[3])));
+      for (unsigned int j = 0; j < 4; ++j)
+        total += partial[j];
+      __m128i zsum = _mm_sad_epu8(zacc, zero);
+      zero_count += (unsigned int)(_mm_cvtsi128_si32(zsum)
+                                   + _mm_cvtsi128_si32(_mm_srli_si128(zsum, 8)));
+    }
+  }
+#endif
+
+#if defined(_HLL_NEON)
+  {
+    const uint32x4_t bias = vdupq_n_u32(127);
+    float partial[4];
+    while (i + 16 <= registers_len)
+    {
+      unsigned int end = i + _HLL_SUM_CHUNK;
+      if (end > registers_len)
+        end = registers_len;
+      // Independent accumulators, so that the additions do not wait
+      // for each other
+      float32x4_t acc[4] = { vdupq_n_f32(0.0f), vdupq_n_f32(0.0f),
+                             vdupq_n_f32(0.0f), vdupq_n_f32(0.0f) };
+      uint8x16_t zacc = vdupq_n_u8(0);
+      for (; i + 16 <= end; i += 16)
+      {
+        uint8x16_t regs = vld1q_u8(registers + i);
+        zacc = vsubq_u8(zacc, vceqq_u8(regs, vdupq_n_u8(0)));
+        uint16x8_t words[2] = { vmovl_u8(vget_low_u8(regs)),
+                                vmovl_u8(vget_high_u8(regs)) };
+        for (unsigned int h = 0; h < 2; ++h)
+        {
+          uint32x4_t lo = vmovl_u16(vget_low_u16(words[h]));
+          uint32x4_t hi = vmovl_u16(vget_high_u16(words[h]));
+          lo = vshlq_n_u32(vsubq_u32(bias, lo), 23);
+          hi = vshlq_n_u32(vsubq_u32(bias, hi), 23);
+          acc[2 * h] = vaddq_f32(acc[2 * h], vreinterpretq_f32_u32(lo));
+          acc[2 * h + 1] = vaddq_f32(acc[2 * h + 1],
+                                     vreinterpretq_f32_u32(hi));
+        }
+      }
+      vst1q_f32(partial, vaddq_f32(vaddq_f32(acc[0], acc[1]),
+                                   vaddq_f32(acc[2], acc[3])));
+      for (unsigned int j = 0; j < 4; ++j)
+        total += partial[j];
+      uint64x2_t zsum = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(zacc)));
+      zero_count += (unsigned int)(vgetq_lane_u64(zsum, 0)
+                                   + vgetq_lane_u64(zsum, 1));
+    }
+  }
+#endif
+
+  for (; i < registers_len; ++i)
+  {
+    total += _hll_inverse_powers[registers[i]];
+    zero_count += (registers[i] == 0);
+  }
+
+  *sum = total;
+  *zeros = zero_count;
+}
+
+// HyperLogLog++ empirical bias correction
+//
+// _hll_biases[precision - HLL_PRECISION_MIN][k] is the mean bias of
+// the raw estimate of an hll with [precision] after k * 2^precision
+// / 16 distinct insertions, so the raw estimate measured at that
+// point is the cardinality plus the bias. The tables were generated
+// by averaging the raw estimate of 2^25 / 2^precision (at least 200,
+// and 1000 for precisions 17 and 18) simulated hlls with uniform 64
+// bit hashes.
+#define _HLL_BIAS_LEN 81
+static const double _hll_biases[HLL_PRECISION_MAX - HLL_PRECISION_MIN + 1]
+                                [_HLL_BIAS_LEN] = {
+  // precision 4
+  {
+    10.77, 10.24, 9.72, 9.22, 8.74, 8.27, 7.82, 7.38, 6.96, 6.56, 6.17,
+    5.79, 5.43, 5.09, 4.76, 4.45, 4.15, 3.87, 3.6, 3.35, 3.11, 2.88,
+    2.67, 2.47, 2.27, 2.1, 1.93, 1.77, 1.63, 1.49, 1.36, 1.25, 1.14,
+    1.04, 0.94, 0.86, 0.78, 0.71, 0.64, 0.58, 0.52, 0.47, 0.42, 0.38,
+    0.34, 0.3, 0.27, 0.24, 0.21, 0.19, 0.17, 0.15, 0.13, 0.12, 0.1,
+    0.09, 0.08, 0.06, 0.05, 0.04, 0.03, 0.02, 0.02, 0.02, 0.01, 0.01,
+    0.01, -0, -0, -0.01, -0.01, -0.02, -0.01, -0.02, -0.02, -0.02,
+    -0.02, -0.03, -0.03, -0.03, -0.03,
+  },
+  // precision 5
+  {
+    22.3, 21.26, 20.25, 19.27, 18.31, 17.39, 16.5, 15.64, 14.8, 14,
+    13.23, 12.49, 11.77, 11.09, 10.43, 9.8, 9.2, 8.63, 8.08, 7.56, 7.07,
+    6.6, 6.16, 5.74, 5.34, 4.96, 4.61, 4.28, 3.96, 3.67, 3.39, 3.13,
+    2.89, 2.66, 2.45, 2.25, 2.07, 1.9, 1.74, 1.59, 1.45, 1.33, 1.21,
+    1.1, 1, 0.91, 0.83, 0.75, 0.68, 0.62, 0.56, 0.51, 0.46, 0.42, 0.38,
+    0.35, 0.32, 0.29, 0.26, 0.24, 0.22, 0.2, 0.18, 0.16, 0.15, 0.14,
+    0.13, 0.12, 0.1, 0.1, 0.08, 0.08, 0.07, 0.06, 0.06, 0.06, 0.05,
+    0.05, 0.05, 0.05, 0.05,
+  },
+  // precision 6
+  {
+    45.38, 43.31, 41.3, 39.35, 37.46, 35.63, 33.86, 32.14, 30.49, 28.89,
+    27.36, 25.87, 24.45, 23.08, 21.77, 20.51, 19.31, 18.16, 17.06,
+    16.01, 15.01, 14.06, 13.15, 12.29, 11.49, 10.71, 9.99, 9.3, 8.64,
+    8.03, 7.45, 6.91, 6.39, 5.92, 5.47, 5.05, 4.66, 4.29, 3.96, 3.64,
+    3.34, 3.07, 2.81, 2.57, 2.34, 2.13, 1.94, 1.77, 1.61, 1.47, 1.34,
+    1.22, 1.1, 1, 0.91, 0.81, 0.73, 0.66, 0.59, 0.53, 0.47, 0.41, 0.36,
+    0.32, 0.29, 0.24, 0.21, 0.19, 0.16, 0.15, 0.14, 0.1, 0.08, 0.05,
+    0.03, 0.01, 0.01, 0, -0.01, -0, -0.01,
+  },
+  // precision 7
+  {
+    91.55, 87.44, 83.44, 79.56, 75.8, 72.15, 68.62, 65.21, 61.91, 58.72,
+    55.65, 52.7, 49.85, 47.11, 44.49, 41.97, 39.56, 37.25, 35.06, 32.96,
+    30.96, 29.05, 27.23, 25.52, 23.87, 22.31, 20.85, 19.45, 18.13,
+    16.89, 15.73, 14.63, 13.59, 12.61, 11.69, 10.84, 10.04, 9.3, 8.6,
+    7.94, 7.34, 6.78, 6.23, 5.75, 5.27, 4.85, 4.45, 4.1, 3.76, 3.45,
+    3.15, 2.88, 2.62, 2.4, 2.2, 1.99, 1.81, 1.64, 1.5, 1.37, 1.22, 1.1,
+    0.98, 0.91, 0.84, 0.76, 0.68, 0.6, 0.55, 0.51, 0.46, 0.4, 0.4, 0.34,
+    0.31, 0.26, 0.23, 0.22, 0.2, 0.2, 0.2,
+  },
+  // precision 8
+  {
+    183.88, 175.67, 167.69, 159.95, 152.43, 145.15, 138.1, 131.28,
+    124.69, 118.32, 112.19, 106.29, 100.61, 95.14, 89.9, 84.86, 80.04,
+    75.43, 71.02, 66.81, 62.8, 58.97, 55.32, 51.85, 48.57, 45.47, 42.51,
+    39.69, 37.07, 34.57, 32.18, 29.96, 27.85, 25.87, 24.01, 22.25,
+    20.61, 19.05, 17.63, 16.28, 15.02, 13.85, 12.73, 11.68, 10.71, 9.84,
+    9.04, 8.28, 7.59, 6.94, 6.4, 5.85, 5.35, 4.89, 4.45, 4.05, 3.7,
+    3.37, 3.06, 2.79, 2.53, 2.26, 2.07, 1.89, 1.73, 1.58, 1.35, 1.24,
+    1.08, 0.99, 0.91, 0.81, 0.71, 0.62, 0.57, 0.54, 0.42, 0.41, 0.34,
+    0.3, 0.28,
+  },
+  // precision 9
+  {
+    368.53, 352.12, 336.18, 320.7, 305.68, 291.12, 277.04, 263.42,
+    250.24, 237.53, 225.29, 213.48, 202.1, 191.17, 180.67, 170.6,
+    160.93, 151.69, 142.89, 134.44, 126.4, 118.75, 111.45, 104.53, 97.9,
+    91.64, 85.75, 80.12, 74.79, 69.77, 65.07, 60.59, 56.39, 52.41,
+    48.71, 45.21, 41.89, 38.83, 35.89, 33.22, 30.65, 28.24, 26.09,
+    24.12, 22.19, 20.5, 18.86, 17.42, 16.06, 14.75, 13.53, 12.41, 11.35,
+    10.4, 9.53, 8.68, 8.03, 7.48, 6.84, 6.33, 5.79, 5.44, 5.03, 4.6,
+    4.23, 3.86, 3.57, 3.26, 2.98, 2.76, 2.52, 2.27, 2.06, 1.86, 1.64,
+    1.5, 1.35, 1.29, 1.25, 1.2, 1.16,
+  },
+  // precision 10
+  {
+    737.83, 705.05, 673.2, 642.26, 612.24, 583.14, 554.94, 527.7,
+    501.35, 475.94, 451.42, 427.81, 405.11, 383.27, 362.23, 342.1,
+    322.78, 304.31, 286.6, 269.78, 253.67, 238.24, 223.58, 209.64,
+    196.45, 183.9, 172.01, 160.69, 149.98, 139.85, 130.45, 121.51,
+    113.15, 105.21, 97.79, 90.77, 84.12, 77.9, 71.97, 66.62, 61.61,
+    56.74, 52.45, 48.34, 44.49, 40.93, 37.78, 34.81, 32.05, 29.68,
+    27.07, 24.75, 22.65, 20.61, 18.81, 17.1, 15.6, 14.53, 13.27, 12.1,
+    11.26, 10.31, 9.31, 8.4, 7.52, 6.81, 6.26, 5.68, 5.12, 4.51, 4.07,
+    3.66, 3.41, 3.36, 3.41, 2.81, 2.49, 2.27, 1.93, 1.97, 1.83,
+  },
+  // precision 11
+  {
+    1476.44, 1410.93, 1347.21, 1285.34, 1225.33, 1167.14, 1110.88,
+    1056.39, 1003.71, 952.92, 903.87, 856.56, 811.2, 767.45, 725.43,
+    685.2, 646.43, 609.5, 574.26, 540.5, 508.13, 477.37, 448.04, 420.11,
+    393.56, 368.44, 344.69, 322.13, 300.9, 280.78, 261.78, 243.93,
+    226.97, 210.93, 196.06, 181.94, 168.52, 156.05, 144.33, 133.55,
+    123.37, 114.2, 105.41, 97.28, 89.43, 82.41, 75.81, 69.48, 63.74,
+    58.65, 53.47, 48.85, 44.42, 40.8, 37.31, 34.13, 31.16, 28.6, 26.07,
+    23.65, 21.75, 19.64, 17.9, 16, 14.71, 13.25, 11.76, 10.72, 9.56,
+    8.58, 7.82, 6.68, 5.75, 5.17, 4.48, 3.85, 3.16, 2.88, 2.63, 2.07,
+    1.56,
+  },
+  // precision 12
+  {
+    2953.67, 2822.61, 2695.2, 2571.53, 2451.53, 2335.14, 2222.52,
+    2113.44, 2008.19, 1906.55, 1808.5, 1714.09, 1623.32, 1535.96,
+    1451.96, 1371.35, 1294.15, 1220.34, 1149.69, 1082.22, 1017.45,
+    955.72, 897.37, 841.73, 789.06, 738.92, 691.36, 646.16, 603.47,
+    562.82, 524.46, 488.26, 454.03, 422, 392.05, 363.95, 337.77, 313.39,
+    289.54, 267.35, 246.84, 227.94, 211.09, 195.05, 179.12, 164.36,
+    151.32, 139.02, 128.09, 117.49, 108.18, 99.41, 91.36, 84.36, 77.39,
+    70.88, 65.03, 59.28, 54.26, 49.48, 45.93, 41.36, 38.16, 34.02,
+    31.17, 28.5, 25.95, 24.41, 22.51, 20.24, 19.22, 18.64, 17.24, 15.66,
+    14, 12.77, 11.62, 10.16, 8.75, 7.8, 7.46,
+  },
+  // precision 13
+  {
+    5908.11, 5645.95, 5391.1, 5143.65, 4903.67, 4671.09, 4445.84,
+    4227.77, 4017.18, 3814.01, 3618.1, 3429.42, 3247.93, 3073.08,
+    2905.09, 2744.02, 2589.07, 2440.92, 2299.64, 2164.24, 2035.22,
+    1912.81, 1795.5, 1683.93, 1577.86, 1477.88, 1382, 1292.73, 1207.44,
+    1126.75, 1050.05, 977.73, 909.85, 845.9, 786.19, 729.08, 676.5,
+    627.1, 580.94, 536.62, 496.24, 457.2, 421.66, 389, 356.61, 329.2,
+    302.98, 278.53, 256.01, 234.97, 215.85, 199.47, 182.77, 166.7,
+    154.82, 141.75, 129.07, 117.66, 107.85, 98.79, 91.65, 84.79, 76.51,
+    71.18, 66.97, 59.56, 55.36, 52.06, 49.77, 46.47, 42.99, 39.96,
+    36.64, 34.43, 32.48, 29.42, 27, 22.44, 21.27, 20.86, 18.37,
+  },
+  // precision 14
+  {
+    11817, 11292.8, 10783.1, 10288.1, 9808.04, 9342.72, 8892.23,
+    8456.96, 8035.29, 7628.59, 7236.31, 6858.65, 6495.44, 6146.32,
+    5810.49, 5488.82, 5179.16, 4882.72, 4601.09, 4330.72, 4072.93,
+    3827.3, 3593.23, 3370.89, 3158.29, 2956.69, 2766.02, 2585.12,
+    2413.62, 2253.01, 2099.53, 1955.29, 1819.93, 1691.74, 1571.81,
+    1460.33, 1354.96, 1255.47, 1162.33, 1074.54, 993.8, 918.55, 846.11,
+    779.47, 717.2, 660.59, 605.9, 556.17, 511.3, 467.32, 427.8, 390.45,
+    360.25, 328.19, 296.62, 272.05, 249.08, 227.68, 207.2, 190.71,
+    171.87, 155.95, 139.73, 128.51, 114.04, 99.66, 87.38, 76.8, 69.96,
+    62.09, 55.82, 52, 47.64, 39.44, 39.42, 36.61, 37.6, 35.04, 29.5,
+    24.42, 22.33,
+  },
+  // precision 15
+  {
+    23634.8, 22586.5, 21567.2, 20577.6, 19617.5, 18687.6, 17786.5,
+    16915.5, 16073.4, 15260.2, 14475.6, 13720.5, 12993.3, 12293.5,
+    11622.6, 10978.2, 10360.2, 9769.46, 9205.39, 8665.8, 8149.79,
+    7658.53, 7191.26, 6746.33, 6322.12, 5921.42, 5541.59, 5178.94,
+    4837.28, 4515.27, 4210.74, 3918.54, 3645.19, 3391.31, 3148.19,
+    2922.81, 2709.74, 2508.13, 2324.17, 2147.6, 1984.19, 1836.41,
+    1696.25, 1564.68, 1440.3, 1328.14, 1223.06, 1125.6, 1035.27, 949.47,
+    871.15, 802.94, 741.74, 676.85, 622.33, 571.55, 522.45, 474.96,
+    434.04, 399.38, 363.97, 334.79, 314.69, 287.33, 261.05, 236.13,
+    213.59, 195.62, 176.63, 157.05, 137.6, 123.98, 113.76, 103.06,
+    94.18, 87.63, 81.33, 75.14, 67.46, 66.05, 58.07,
+  },
+  // precision 16
+  {
+    47270.3, 45173.8, 43134.9, 41155.4, 39235.2, 37374.3, 35572.4,
+    33831.1, 32146.5, 30521.1, 28950.7, 27436.8, 25981, 24582, 23238.3,
+    21951.5, 20713.5, 19532, 18400.5, 17317.5, 16284.9, 15303.7,
+    14367.4, 13475.8, 12628.5, 11822.5, 11064.4, 10341.7, 9662.69,
+    9019.44, 8405.01, 7827.82, 7286.48, 6774.53, 6296.61, 5853.04,
+    5435.94, 5041.18, 4665.8, 4315.45, 3990.78, 3679.38, 3398.33,
+    3134.67, 2890.92, 2660.78, 2458.17, 2254.51, 2072.7, 1906.32,
+    1751.56, 1604.88, 1473.91, 1351.77, 1253.41, 1150.84, 1063.59,
+    975.49, 891.7, 815.11, 744.07, 683.46, 630.65, 580.4, 543.74,
+    508.93, 488.72, 447.83, 412.43, 381.73, 359.14, 345.59, 330.7,
+    311.95, 292.37, 281.47, 271.6, 270.63, 253.57, 239.53, 232.23,
+  },
+  // precision 17
+  {
+    94541.5, 90348.1, 86271.4, 82312.7, 78472.2, 74750, 71145.4,
+    67659.5, 64291.7, 61038.9, 57900.4, 54879.6, 51971.6, 49175.8,
+    46486.7, 43910.1, 41440.3, 39075.6, 36810.4, 34649.1, 32586.9,
+    30617.3, 28747.1, 26959, 25271.2, 23664.3, 22133.6, 20686.8, 19316,
+    18017.6, 16793.4, 15641.9, 14555, 13537.2, 12573.3, 11672.4,
+    10825.5, 10026, 9290.11, 8603.95, 7951.91, 7353.53, 6784.35,
+    6251.42, 5763.72, 5313.79, 4873.82, 4489.52, 4122.05, 3788.72,
+    3480.61, 3204.4, 2932.54, 2686.22, 2462.23, 2248.55, 2046.88,
+    1872.04, 1714.81, 1563.9, 1427.86, 1302.38, 1194.32, 1088.93,
+    1010.31, 927.41, 858.68, 780.67, 723.03, 663.53, 614.58, 564.84,
+    544.09, 497.98, 462.17, 433.53, 409.3, 382.28, 373.88, 366.43,
+    342.47,
+  },
+  // precision 18
+  {
+    189084, 180695, 172542, 164626, 156945, 149499, 142287, 135315,
+    128578, 122073, 115802, 109762, 103944, 98350.1, 92971.4, 87813.7,
+    82876.4, 78146.7, 73621.8, 69296.6, 65163.6, 61225.7, 57482.1,
+    53918.5, 50515.8, 47295.4, 44229.7, 41338.6, 38594.1, 36012.9,
+    33571.7, 31262.9, 29086.1, 27048.5, 25115, 23309.6, 21611.4,
+    20019.7, 18535.2, 17142.6, 15836.8, 14611.1, 13486, 12426.4,
+    11430.7, 10523.3, 9659.19, 8865.33, 8142.1, 7465.58, 6833.84,
+    6245.08, 5719.2, 5217.5, 4749.13, 4316.57, 3944.45, 3591.15,
+    3275.13, 2954.48, 2656.64, 2412.25, 2196.17, 1992.41, 1801.22,
+    1630.7, 1456.08, 1342.45, 1209.63, 1088.34, 985.36, 875.17, 794.4,
+    716.09, 637.29, 566.08, 515.84, 459.87, 415.61, 371.95, 323.27,
+  },
+};
+
+// Linear counting is used below these cardinalities, for precisions
+// HLL_PRECISION_MIN to HLL_PRECISION_MAX
+static const double _hll_thresholds[HLL_PRECISION_MAX - HLL_PRECISION_MIN
+                                   + 1] = {
+  10, 20, 40, 80, 220, 400, 900, 1800, 3100, 6500, 11500, 20000, 50000,
+  120000, 350000,
+};
+
+// Bias of a raw estimate, interpolated from _hll_biases
+HLL_DEF double _hll_bias(unsigned int precision, double estimate)
+{
+  const double *bias = _hll_biases[precision - HLL_PRECISION_MIN];
+  const double step  = (double)(1u << precision) / 16;
+#define _HLL_BIAS_RAW(k) ((k) * step + bias[k])
+
+  if (estimate <= _HLL_BIAS_RAW(0))
+    return bias[0];
+  if (estimate >= _HLL_BIAS_RAW(_HLL_BIAS_LEN - 1))
+    return bias[_HLL_BIAS_LEN - 1];
+
+  // Find lo such that raw(lo) <= estimate < raw(lo + 1)
+  unsigned int lo = 0, hi = _HLL_BIAS_LEN - 1;
+  while (hi - lo > 1)
+  {
+    unsigned int mid = (lo + hi) / 2;
+    if (_HLL_BIAS_RAW(mid) <= estimate)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  double raw_lo = _HLL_BIAS_RAW(lo);
+  double t = (estimate - raw_lo) / (_HLL_BIAS_RAW(hi) - raw_lo);
+#undef _HLL_BIAS_RAW
+  return bias[lo] + t * (bias[hi] - bias[lo]);
+}
+
+// Bias correction constant of the raw estimate
+HLL_DEF double _hll_alpha(unsigned int precision)
+{
+  // Read the paper to understand what is happening
+  unsigned int registers_len = (1 << precision);
+  switch(registers_len)
+  {
+  case 16:
+    return 0.673;
+  case 32:
+    return 0.697;
+  case 64:
+    return 0.709;
+  default:
+    return 0.7213 / (1 + 1.079 / (registers_len));
+  }
+}
+
+// Estimate the cardinality from the harmonic sum of the registers
+// and the number of zero registers
+HLL_DEF long long _hll_estimate(unsigned int precision,
+                                double sum,
+                                unsigned int num_of_zero_registers)
+{
+  unsigned int registers_len = (1 << precision);
+  double magic = _hll_alpha(precision);
+
+  double estimate = magic * registers_len * registers_len * (1 / sum);
+  if (estimate <= 5.0 * registers_len)
+    estimate -= _hll_bias(precision, estimate);
+
+  if (num_of_zero_registers != 0)
+  {
+    // Linear counting
+    double linear = registers_len
+      * HLL_LOG((double)registers_len / num_of_zero_registers);
+    if (linear <= _hll_thresholds[precision - HLL_PRECISION_MIN])
+      return (long long)(linear + 0.5);
+  }
+
+  // The large range correction is only needed when the estimate
+  // gets close to the number of possible hash values
+  const double hash_range = (double)(hll_hash_t)~(hll_hash_t)0 + 1.0;
+  if (sizeof(hll_hash_t) >= 8 || estimate <= hash_range / 30)
+    return (long long)(estimate + 0.5);
+
+  return (long long)(-hash_range * HLL_LOG(1 - estimate / hash_range) + 0.5);
+}
+
+// Add the counts of the values of [len] 8 bit registers to
+// histogram
+HLL_DEF void _hll_bytes_histogram(const unsigned char *registers,
+                                  unsigned int len,
+                                  unsigned int *histogram)
+{
+  // Four histograms avoid stalls on consecutive equal registers
+  unsigned int partial[4][HLL_REGISTER_MAX + 1] = {{0}};
+  unsigned int i = 0;
+  for (; i + 4 <= len; i += 4)
+  {
+    partial[0][registers[i] & HLL_REGISTER_MAX]++;
+    partial[1][registers[i + 1] & HLL_REGISTER_MAX]++;
+    partial[2][registers[i + 2] & HLL_REGISTER_MAX]++;
+    partial[3][registers[i + 3] & HLL_REGISTER_MAX]++;
+  }
+  for (; i < len; ++i)
+    partial[0][registers[i] & HLL_REGISTER_MAX]++;
+
+  for (unsigned int k = 0; k <= HLL_REGISTER_MAX; ++k)
+    histogram[k] += partial[0][k] + partial[1][k]
+      + partial[2][k] + partial[3][k];
+}
+
+// Count the registers with each value, histogram must hold
+// HLL_REGISTER_MAX + 1 counters
+HLL_DEF void _hll_registers_histogram(const hll_t *hll,
+                                      unsigned int *histogram)
+{
+  const unsigned int registers_len = 1u << hll->precision;
+  for (unsigned int k = 0; k <= HLL_REGISTER_MAX; ++k)
+    histogram[k] = 0;
+
+  if (hll->register_bits == 6)
+  {
+    for (unsigned int i = 0; i < registers_len; ++i)
+      histogram[hll_get_register(hll, i)]++;
+    return;
+  }
+
+  _hll_bytes_histogram(hll->_registers, registers_len, histogram);
+}
+
+// sigma(x) = x + sum_k x^(2^k) 2^(k-1) for x < 1, see the paper of
+// Ertl
+HLL_DEF double _hll_ertl_sigma(double x)
+{
+  double y = 1.0;
+  double z = x;
+  double z_prev;
+  do {
+    x *= x;
+    z_prev = z;
+    z += x * y;
+    y += y;
+  } while (z != z_prev);
+  return z;
+}
+
+// tau(x) = (1 - x - sum_k (1 - x^(2^-k))^2 2^-k) / 3, see the paper
+// of Ertl
+HLL_DEF double _hll_ertl_tau(double x)
+{
+  if (x == 0.0 || x == 1.0)
+    return 0.0;
+
+  double y = 1.0;
+  double z = 1.0 - x;
+  double z_prev;
+  do {
+    x = HLL_SQRT(x);
+    z_prev = z;
+    y *= 0.5;
+    z -= (1.0 - x) * (1.0 - x) * y;
+  } while (z != z_prev);
+  return z / 3.0;
+}
+
+// Estimate the cardinality from the histogram of the register values
+// with the improved raw estimator of Ertl
+HLL_DEF long long _hll_estimate_ertl(unsigned int precision,
+                                     const unsigned int *histogram)
+{
+  const double registers_len = (double)(1u << precision);
+  if (histogram[0] == 1u << precision)
+    return 0;
+
+  // Registers hold at most q + 1
+  const unsigned int q = sizeof(hll_hash_t) * 8 - precision;
+  double z = registers_len
+    * _hll_ertl_tau(1.0 - histogram[q + 1] / registers_len);
+  for (unsigned int k = q; k >= 1; --k)
+    z = 0.5 * (z + histogram[k]);
+  z += registers_len * _hll_ertl_sigma(histogram[0] / registers_len);
+
+  return (long long)(_hll_alpha(precision) * registers_len * registers_len
+                     / z + 0.5);
+}
+
+// hll_count without the stats and hooks
+HLL_DEF long long _hll_count(hll_t *hll)
+{
+  if (hll == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (hll->representation == 0)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  if (hll->cached && !(hll->_flags & _HLL_FLAG_DIRTY))
+    return hll->_count;
+
+  if (hll->representation == HLL_REPRESENTATION_SPARSE)
+  {
+    hll_error err = _hll_sparse_flush(hll);
+    if (err != HLL_OK)
+      return err;
+  }
+
+  long long count;
+  if (hll->representation == HLL_REPRESENTATION_SPARSE)
+  {
+    // Linear counting over the 2^HLL_SPARSE_PRECISION sparse registers
+    double sparse_len = (double)(1u << HLL_SPARSE_PRECISION);
+    double zeros      = sparse_len - hll->_sparse.list_count;
+    count = (long long)(sparse_len * HLL_LOG(sparse_len / zeros) + 0.5);
+  } else if (hll->estimator == HLL_ESTIMATOR_ERTL
+             || (hll->estimator == 0
+                 && HLL_ESTIMATOR == HLL_ESTIMATOR_ERTL))
+  {
+    unsigned int histogram[HLL_REGISTER_MAX + 1];
+    _hll_registers_histogram(hll, histogram);
+    count = _hll_estimate_ertl(hll->precision, histogram);
+  } else if (hll->cached)
+  {
+    if (hll->_flags & _HLL_FLAG_SUM_STALE)
+      _hll_registers_sum(hll, &hll->_sum, &hll->_zeros);
+    count = _hll_estimate(hll->precision, hll->_sum, hll->_zeros);
+  } else {
+    double sum;
+    unsigned int num_of_zero_registers;
+    _hll_registers_sum(hll, &sum, &num_of_zero_registers);
+    count = _hll_estimate(hll->precision, sum, num_of_zero_registers);
+  }
+
+  if (hll->cached)
+  {
+    hll->_count = count;
+    hll->_flags &= ~(unsigned int)(_HLL_FLAG_DIRTY | _HLL_FLAG_SUM_STALE);
+  }
+  
+  return count;
+}
+
+HLL_DEF long long hll_count(hll_t *hll)
+{
+  if (hll == NULL || hll->representation == 0)
+    return _hll_count(hll);
+
+  _HLL_STAT_ADD(hll, counts, 1);
+  _HLL_HOOK(hll, before, HLL_OPERATION_COUNT);
+  long long count = _hll_count(hll);
+  _HLL_HOOK(hll, after, HLL_OPERATION_COUNT, count);
+  return count;
+}
+
+// Element-wise maximum of [len] 8 bit registers, stored in dest
+HLL_DEF void _hll_registers_max(unsigned char *dest,
+                                const unsigned char *src,
+                                unsigned int len)
+{
+  unsigned int i = 0;
+#if defined(_HLL_AVX2)
+  for (; i + 32 <= len; i += 32)
+  {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(dest + i));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(src + i));
+    _mm256_storeu_si256((__m256i*)(dest + i), _mm256_max_epu8(a, b));
+  }
+#endif
+#if defined(_HLL_SSE2)
+  for (; i + 16 <= len; i += 16)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i*)(dest + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(src + i));
+    _mm_storeu_si128((__m128i*)(dest + i), _mm_max_epu8(a, b));
+  }
+#endif
+#if defined(_HLL_NEON)
+  for (; i + 16 <= len; i += 16)
+    vst1q_u8(dest + i, vmaxq_u8(vld1q_u8(dest + i), vld1q_u8(src + i)));
+#endif
+  for (; i < len; ++i)
+    dest[i] = (dest[i] > src[i]) ? dest[i] : src[i];
+}
+
+// Merge the dense registers of [hll_src] in the dense registers of
+// [hll_dest] which has a lower precision
+//
+// A source register j maps to the destination register with the first
+// dest precision bits of j. If the dropped bits of j are not all zero,
+// they begin the hash tail of the destination so the rank is given by
+// their leading zeros, otherwise they add to the source rank.
+HLL_DEF void _hll_merge_folded(hll_t *hll_dest, const hll_t *hll_src)
+{
+  const unsigned int shift = hll_src->precision - hll_dest->precision;
+  const unsigned int dropped_mask = (1u << shift) - 1;
+  const unsigned int src_len = 1u << hll_src->precision;
+  for (unsigned int j = 0; j < src_len; ++j)
+  {
+    unsigned int rank = _hll_register_read(hll_src, j);
+    if (rank == 0)
+      continue;
+
+    unsigned int dropped = j & dropped_mask;
+    if (dropped != 0)
+      rank = _hll_clz32((uint32_t)dropped << (32 - shift)) + 1;
+    else
+      rank += shift;
+
+    _hll_register_update(hll_dest, j >> shift, rank);
+  }
+}
+
+// hll_merge without the stats and hooks
+HLL_DEF hll_error _hll_merge(hll_t *hll_dest, hll_t *hll_src)
+{
+  if (hll_dest == NULL || hll_src == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (hll_dest->representation == 0 || hll_src->representation == 0)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  if (hll_dest == hll_src)
+    return HLL_OK;
+
+  // The low precision registers do not have enough information
+  if (hll_src->precision < hll_dest->precision)
+    return HLL_ERROR_PRECISION_MISMATCH;
+
+  hll_error err;
+  if (hll_src->representation == HLL_REPRESENTATION_SPARSE)
+  {
+    // Entries are meaningful for any precision up to
+    // HLL_SPARSE_PRECISION, a sparse destination stores them as they
+    // are and a dense one decodes them
+    const hll_sparse_t *sparse = &hll_src->_sparse;
+    unsigned int pos = 0;
+    uint32_t entry = 0;
+    for (unsigned int i = 0; i < sparse->list_count; ++i)
+    {
+      entry += _hll_varint_read(sparse->list, &pos);
+      if ((err = _hll_sparse_add_entry(hll_dest, entry)) != HLL_OK)
+        return err;
+    }
+    for (unsigned int i = 0; i < sparse->buffer_len; ++i)
+      if ((err = _hll_sparse_add_entry(hll_dest,
+                                       sparse->buffer[i])) != HLL_OK)
+        return err;
+    return HLL_OK;
+  }
+
+  if (hll_dest->representation == HLL_REPRESENTATION_SPARSE
+      && (err = _hll_sparse_to_dense(hll_dest)) != HLL_OK)
+    return err;
+
+  if (hll_src->precision > hll_dest->precision)
+  {
+    _hll_merge_folded(hll_dest, hll_src);
+    return HLL_OK;
+  }
+
+  const unsigned int registers_len = 1u << hll_dest->precision;
+
+  if (hll_dest->register_bits == 8 && hll_src->register_bits == 8
+      && !hll_dest->concurrent && !hll_src->concurrent
+      && !hll_dest->track_changes)
+  {
+    _hll_registers_max(hll_dest->_registers, hll_src->_registers,
+                       registers_len);
+    if (hll_dest->cached)
+      hll_dest->_flags |= _HLL_FLAG_DIRTY | _HLL_FLAG_SUM_STALE;
+    return HLL_OK;
+  }
+
+  for (unsigned int i = 0; i < registers_len; ++i)
+  {
+    unsigned int src = _hll_register_read(hll_src, i);
+    _hll_register_update(hll_dest, i, src);
+  }
+  
+  return HLL_OK;
+}
+
+hll_error hll_merge(hll_t *hll_dest, hll_t *hll_src)
+{
+  if (hll_dest == NULL || hll_dest->representation == 0)
+    return _hll_merge(hll_dest, hll_src);
+
+  _HLL_STAT_ADD(hll_dest, merges, 1);
+  _HLL_HOOK(hll_dest, before, HLL_OPERATION_MERGE);
+  hll_error err = _hll_merge(hll_dest, hll_src);
+  _HLL_HOOK(hll_dest, after, HLL_OPERATION_MERGE, err);
+  return err;
+}
+
+HLL_DEF hll_error hll_fold(hll_t *hll, unsigned int precision)
+{
+  if (hll == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (hll->representation == 0)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  if (precision < HLL_PRECISION_MIN || precision > hll->precision)
+    return HLL_ERROR_INVALID_PRECISION;
+
+  if (precision == hll->precision)
+    return HLL_OK;
+
+  // Deltas of the old precision could not be applied to replicas
+  if (hll->track_changes)
+    return HLL_ERROR_UNSUPPORTED;
+
+  // Sparse entries hold the full HLL_SPARSE_PRECISION index and are
+  // decoded for the precision of the hll
+  if (hll->representation == HLL_REPRESENTATION_SPARSE)
+  {
+    hll->precision = precision;
+    hll->_sum      = (double)(1u << precision);
+    hll->_zeros    = 1u << precision;
+    hll->_flags   |= _HLL_FLAG_DIRTY;
+    return HLL_OK;
+  }
+
+  hll_t folded = *hll;
+  folded.precision = precision;
+  folded._registers = _hll_calloc(hll, HLL_REGISTERS_SIZE(precision,
+                                                          hll->register_bits),
+                                  1);
+  if (folded._registers == NULL)
+    return HLL_ERROR_ALLOCATING_MEMORY;
+
+  // The cached sum of the empty registers, updated by the merge
+  folded._sum    = (double)(1u << precision);
+  folded._zeros  = 1u << precision;
+  folded._flags |= _HLL_FLAG_DIRTY;
+  _hll_merge_folded(&folded, hll);
+  if (!(hll->_flags & _HLL_FLAG_BORROWED))
+    _hll_free(hll, hll->_registers);
+  folded._flags &= ~(unsigned int)_HLL_FLAG_BORROWED;
+  *hll = folded;
+
+  return HLL_OK;
+}
+
+// Check if hll_merge_many can merge [hll_src] in blocks
+#define _HLL_MERGE_BLOCKED(hll_dest, hll_src)                      \
+  ((hll_dest)->representation == HLL_REPRESENTATION_DENSE          \
+   && (hll_src)->representation == HLL_REPRESENTATION_DENSE         \
+   && (hll_dest)->register_bits == 8 && (hll_src)->register_bits == 8 \
+   && (hll_dest)->precision == (hll_src)->precision                 \
+   && !(hll_dest)->concurrent && !(hll_src)->concurrent            \
+   && !(hll_dest)->track_changes && (hll_dest) != (hll_src))
+
+// hll_merge_many without the stats and hooks
+HLL_DEF hll_error _hll_merge_many(hll_t *hll_dest,
+                                  hll_t **hll_srcs,
+                                  unsigned int n)
+{
+  if (hll_dest == NULL || (n > 0 && hll_srcs == NULL))
+    return HLL_ERROR_HLL_NULL;
+
+  if (hll_dest->representation == 0)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  int has_dense = 0;
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    if (hll_srcs[i] == NULL)
+      return HLL_ERROR_HLL_NULL;
+    if (hll_srcs[i]->representation == 0)
+      return HLL_ERROR_HLL_UNINITIALIZED;
+    if (hll_srcs[i]->representation == HLL_REPRESENTATION_DENSE)
+      has_dense = 1;
+  }
+
+  hll_error err;
+  if (has_dense && hll_dest->representation == HLL_REPRESENTATION_SPARSE
+      && (err = _hll_sparse_to_dense(hll_dest)) != HLL_OK)
+    return err;
+
+  for (unsigned int i = 0; i < n; ++i)
+    if (!_HLL_MERGE_BLOCKED(hll_dest, hll_srcs[i])
+        && (err = _hll_merge(hll_dest, hll_srcs[i])) != HLL_OK)
+      return err;
+
+  if (hll_dest->representation != HLL_REPRESENTATION_DENSE)
+    return HLL_OK;
+
+  if (hll_dest->cached)
+    hll_dest->_flags |= _HLL_FLAG_DIRTY | _HLL_FLAG_SUM_STALE;
+
+  const unsigned int registers_len = 1u << hll_dest->precision;
+  for (unsigned int start = 0; start < registers_len; start += HLL_MERGE_BLOCK)
+  {
+    unsigned int len = registers_len - start;
+    if (len > HLL_MERGE_BLOCK)
+      len = HLL_MERGE_BLOCK;
+    for (unsigned int i = 0; i < n; ++i)
+      if (_HLL_MERGE_BLOCKED(hll_dest, hll_srcs[i]))
+        _hll_registers_max(hll_dest->_registers + start,
+                           hll_srcs[i]->_registers + start, len);
+  }
+
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_merge_many(hll_t *hll_dest,
+                                 hll_t **hll_srcs,
+                                 unsigned int n)
+{
+  if (hll_dest == NULL || hll_dest->representation == 0)
+    return _hll_merge_many(hll_dest, hll_srcs, n);
+
+  _HLL_STAT_ADD(hll_dest, merges, n);
+  _HLL_HOOK(hll_dest, before, HLL_OPERATION_MERGE);
+  hll_error err = _hll_merge_many(hll_dest, hll_srcs, n);
+  _HLL_HOOK(hll_dest, after, HLL_OPERATION_MERGE, err);
+  return err;
+}
+
+// Estimate the cardinality from the histogram of the register values
+// with [estimator], as hll_count does
+HLL_DEF long long _hll_estimate_histogram(unsigned int precision,
+                                          unsigned int estimator,
+                                          const unsigned int *histogram)
+{
+  if (estimator == HLL_ESTIMATOR_ERTL
+      || (estimator == 0 && HLL_ESTIMATOR == HLL_ESTIMATOR_ERTL))
+    return _hll_estimate_ertl(precision, histogram);
+
+  double sum = 0;
+  for (unsigned int k = 0; k <= HLL_REGISTER_MAX; ++k)
+    sum += histogram[k] * _hll_inverse_powers[k];
+  return _hll_estimate(precision, sum, histogram[0]);
+}
+
+HLL_DEF long long hll_count_union(hll_t **hlls, unsigned int n)
+{
+  if (n > 0 && hlls == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  unsigned int precision = HLL_PRECISION_MAX;
+  int fused = 1;
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    if (hlls[i] == NULL)
+      return HLL_ERROR_HLL_NULL;
+    if (hlls[i]->representation == 0)
+      return HLL_ERROR_HLL_UNINITIALIZED;
+    if (hlls[i]->representation != HLL_REPRESENTATION_DENSE
+        || hlls[i]->precision != hlls[0]->precision)
+      fused = 0;
+    if (hlls[i]->precision < precision)
+      precision = hlls[i]->precision;
+  }
+
+  if (n == 0)
+    return 0;
+
+  if (!fused)
+  {
+    hll_t merged;
+    hll_error err = hll_init(&merged,
+                             .precision = precision,
+                             .register_bits = 8,
+                             .representation = HLL_REPRESENTATION_DENSE,
+                             .estimator = hlls[0]->estimator);
+    if (err != HLL_OK)
+      return err;
+    err = hll_merge_many(&merged, hlls, n);
+    long long count = (err == HLL_OK) ? hll_count(&merged) : err;
+    hll_destroy(&merged);
+    return count;
+  }
+
+  // The maximum of each block of registers is built on the stack and
+  // added to the histogram while it is still in cache
+  unsigned int histogram[HLL_REGISTER_MAX + 1] = {0};
+  unsigned char block[HLL_MERGE_BLOCK];
+  const unsigned int registers_len = 1u << precision;
+  for (unsigned int start = 0; start < registers_len; start += HLL_MERGE_BLOCK)
+  {
+    unsigned int len = registers_len - start;
+    if (len > HLL_MERGE_BLOCK)
+      len = HLL_MERGE_BLOCK;
+    memset(block, 0, len);
+    for (unsigned int i = 0; i < n; ++i)
+    {
+      if (hlls[i]->register_bits == 8)
+      {
+        _hll_registers_max(block, hlls[i]->_registers + start, len);
+        continue;
+      }
+      for (unsigned int j = 0; j < len; ++j)
+      {
+        unsigned int value = hll_get_register(hlls[i], start + j);
+        if (value > block[j])
+          block[j] = (unsigned char)value;
+      }
+    }
+    _hll_bytes_histogram(block, len, histogram);
+  }
+
+  return _hll_estimate_histogram(precision, hlls[0]->estimator, histogram);
+}
+
+// Histograms of the register values of two hlls A and B, split by
+// the order of the registers with the same index
+typedef struct {
+  unsigned int precision;
+  // Values of A and of B where the register of A is lower
+  unsigned int less_a[HLL_REGISTER_MAX + 1];
+  unsigned int less_b[HLL_REGISTER_MAX + 1];
+  // Values of A and of B where the register of A is higher
+  unsigned int greater_a[HLL_REGISTER_MAX + 1];
+  unsigned int greater_b[HLL_REGISTER_MAX + 1];
+  // Values where the registers are equal
+  unsigned int equal[HLL_REGISTER_MAX + 1];
+} _hll_joint_histograms_t;
+
+// Logarithm of the probability that a register is [k], when the
+// number of distinct hashes falling in it is Poisson distributed
+// with mean [rate] > 0, and its first and second derivatives with
+// respect to the rate. Registers hold at most q + 1.
+HLL_DEF double _hll_log_pmf(double rate,
+                            unsigned int k,
+                            unsigned int q,
+                            double *d1,
+                            double *d2)
+{
+  if (k == 0)
+  {
+    *d1 = -1;
+    *d2 = 0;
+    return -rate;
+  }
+
+  // P(k) = e^-t (1 - e^-t) with t = rate 2^-k, or 1 - e^-t with
+  // t = rate 2^-q for the last value
+  const double scale = _hll_inverse_powers[(k > q) ? q : k];
+  const double t = rate * scale;
+  double tail, e;
+  if (t < 1e-5)
+  {
+    tail = t * (1 - 0.5 * t);
+    e = 1 - tail;
+  } else {
+    e = HLL_EXP(-t);
+    tail = 1 - e;
+  }
+
+  *d1 = scale * e / tail - ((k > q) ? 0.0 : scale);
+  *d2 = -scale * scale * e / (tail * tail);
+  return HLL_LOG(tail) - ((k > q) ? 0.0 : t);
+}
+
+// Add [count] times a term of the log likelihood which depends on
+// the sum of the rates [i] and [j], with derivatives [d1] and [d2],
+// to the gradient and the Hessian. i == j for a term of one rate.
+HLL_DEF void _hll_joint_add(double *gradient,
+                            double (*hessian)[3],
+                            unsigned int count,
+                            double d1,
+                            double d2,
+                            unsigned int i,
+                            unsigned int j)
+{
+  gradient[i] += count * d1;
+  hessian[i][i] += count * d2;
+  if (i == j)
+    return;
+  gradient[j] += count * d1;
+  hessian[j][j] += count * d2;
+  hessian[i][j] += count * d2;
+  hessian[j][i] += count * d2;
+}
+
+// Log likelihood of the joint histograms when the elements only in
+// A, only in B and in both are Poisson distributed with means
+// rates[0] * m, rates[1] * m and rates[2] * m, where m is the
+// number of registers. Its gradient and Hessian with respect to the
+// rates are stored in [gradient] and [hessian].
+//
+// A register is at most k with probability F(k) = e^-(rate 2^-k)
+// for k <= q, and 1 for the highest value q + 1. A register of A is
+// the maximum of the registers of the elements only in A and of the
+// elements in both, which are independent.
+HLL_DEF double _hll_joint_log_likelihood(const _hll_joint_histograms_t *h,
+                                         const double *rates,
+                                         double *gradient,
+                                         double (*hessian)[3])
+{
+  const unsigned int q = sizeof(hll_hash_t) * 8 - h->precision;
+  const double a = rates[0], b = rates[1], x = rates[2];
+  double likelihood = 0;
+  double d1, d2;
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    gradient[i] = 0;
+    hessian[i][0] = hessian[i][1] = hessian[i][2] = 0;
+  }
+
+  for (unsigned int k = 0; k <= q + 1; ++k)
+  {
+    unsigned int count;
+    if ((count = h->less_a[k]) != 0)
+    {
+      likelihood += count * _hll_log_pmf(a + x, k, q, &d1, &d2);
+      _hll_joint_add(gradient, hessian, count, d1, d2, 0, 2);
+    }
+    if ((count = h->less_b[k]) != 0)
+    {
+      likelihood += count * _hll_log_pmf(b, k, q, &d1, &d2);
+      _hll_joint_add(gradient, hessian, count, d1, d2, 1, 1);
+    }
+    if ((count = h->greater_a[k]) != 0)
+    {
+      likelihood += count * _hll_log_pmf(a, k, q, &d1, &d2);
+      _hll_joint_add(gradient, hessian, count, d1, d2, 0, 0);
+    }
+    if ((count = h->greater_b[k]) != 0)
+    {
+      likelihood += count * _hll_log_pmf(b + x, k, q, &d1, &d2);
+      _hll_joint_add(gradient, hessian, count, d1, d2, 1, 2);
+    }
+    if ((count = h->equal[k]) == 0)
+      continue;
+
+    // Either the elements in both reach k and the others do not go
+    // beyond, or the elements only in A and only in B reach k and the
+    // elements in both stay below. The log of the sum of the two
+    // probabilities is computed from their logs s and p, with their
+    // gradients ds and dp and the diagonals of their Hessians.
+    const double scale = (k > q) ? 0.0 : _hll_inverse_powers[k];
+    double s, ds[3], dds[3] = {0}, p, dp[3], ddp[3] = {0};
+    s = _hll_log_pmf(x, k, q, &ds[2], &dds[2]) - (a + b) * scale;
+    ds[0] = ds[1] = -scale;
+    if (k == 0)
+    {
+      likelihood += count * s;
+      for (unsigned int i = 0; i < 3; ++i)
+        gradient[i] += count * ds[i];
+      continue;
+    }
+    p = _hll_log_pmf(a, k, q, &dp[0], &ddp[0])
+      + _hll_log_pmf(b, k, q, &dp[1], &ddp[1])
+      - x * _hll_inverse_powers[k - 1];
+    dp[2] = -_hll_inverse_powers[k - 1];
+
+    double w;
+    if (s > p)
+    {
+      double e = HLL_EXP(p - s);
+      likelihood += count * (s + HLL_LOG(1 + e));
+      w = 1 / (1 + e);
+    } else {
+      double e = HLL_EXP(s - p);
+      likelihood += count * (p + HLL_LOG(1 + e));
+      w = e / (1 + e);
+    }
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+      gradient[i] += count * (w * ds[i] + (1 - w) * dp[i]);
+      hessian[i][i] += count * (w * dds[i] + (1 - w) * ddp[i]);
+      for (unsigned int j = 0; j < 3; ++j)
+        hessian[i][j] += count * w * (1 - w)
+          * (ds[i] - dp[i]) * (ds[j] - dp[j]);
+    }
+  }
+  return likelihood;
+}
+
+// Maximize _hll_joint_log_likelihood starting from [rates] with the
+// Newton method, keeping the rates positive. The maximum is stored
+// in [rates].
+HLL_DEF void _hll_joint_maximize(const _hll_joint_histograms_t *h,
+                                 double *rates)
+{
+  // Rates are kept above a millionth of an element, which is 0 once
+  // rounded
+  const double min_rate = 1e-6 / (double)(1u << h->precision);
+  for (unsigned int i = 0; i < 3; ++i)
+    if (rates[i] < min_rate)
+      rates[i] = min_rate;
+
+  double gradient[3], hessian[3][3];
+  double likelihood = _hll_joint_log_likelihood(h, rates, gradient, hessian);
+  for (unsigned int iteration = 0; iteration < 50; ++iteration)
+  {
+    // Rates on the bound that would decrease further stay there
+    int free[3];
+    for (unsigned int i = 0; i < 3; ++i)
+      free[i] = !(rates[i] <= min_rate && gradient[i] <= 0);
+
+    // Solve -hessian direction = gradient over the free rates with a
+    // Cholesky decomposition, adding to the diagonal until the matrix
+    // is positive definite
+    double direction[3] = {0};
+    double damping = 0;
+    for (unsigned int tries = 0; tries < 20; ++tries)
+    {
+      double l[3][3] = {{0}};
+      int ok = 1;
+      for (unsigned int i = 0; i < 3 && ok; ++i)
+      {
+        if (!free[i])
+          continue;
+        for (unsigned int j = 0; j <= i; ++j)
+        {
+          if (!free[j])
+            continue;
+          double sum = -hessian[i][j] + ((i == j) ? damping : 0.0);
+          for (unsigned int k = 0; k < j; ++k)
+            sum -= l[i][k] * l[j][k];
+          if (i != j)
+            l[i][j] = sum / l[j][j];
+          else if (sum > 0)
+            l[i][i] = HLL_SQRT(sum);
+          else
+            ok = 0;
+        }
+      }
+      if (ok)
+      {
+        double z[3] = {0};
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+          if (!free[i])
+            continue;
+          double sum = gradient[i];
+          for (unsigned int k = 0; k < i; ++k)
+            sum -= l[i][k] * z[k];
+          z[i] = sum / l[i][i];
+        }
+        for (unsigned int i = 3; i-- > 0;)
+        {
+          if (!free[i])
+            continue;
+          double sum = z[i];
+          for (unsigned int k = i + 1; k < 3; ++k)
+            sum -= l[k][i] * direction[k];
+          direction[i] = sum / l[i][i];
+        }
+        break;
+      }
+
+      double diagonal = 0;
+      for (unsigned int i = 0; i < 3; ++i)
+        if (free[i] && -hessian[i][i] > diagonal)
+          diagonal = -hessian[i][i];
+      damping = (damping == 0) ? 1e-9 * diagonal + 1e-30 : damping * 100;
+    }
+
+    // Half the decrement estimates the remaining gain of the log
+    // likelihood, differences this small do not change the estimates
+    double decrement = 0;
+    for (unsigned int i = 0; i < 3; ++i)
+      decrement += gradient[i] * direction[i];
+    if (!(decrement > 1e-9))
+      break;
+
+    // Backtrack until the log likelihood increases enough
+    double step = 1, next[3], next_gradient[3], next_hessian[3][3];
+    double next_likelihood;
+    unsigned int tries = 0;
+    for (;;)
+    {
+      double gain = 0;
+      for (unsigned int i = 0; i < 3; ++i)
+      {
+        next[i] = rates[i] + step * direction[i];
+        if (next[i] < min_rate)
+          next[i] = min_rate;
+        gain += gradient[i] * (next[i] - rates[i]);
+      }
+      next_likelihood = _hll_joint_log_likelihood(h, next, next_gradient,
+                                                  next_hessian);
+      if (next_likelihood >= likelihood + 1e-4 * gain)
+        break;
+      if (++tries == 30)
+        return;
+      step *= 0.5;
+    }
+
+    likelihood = next_likelihood;
+    memcpy(rates, next, sizeof(next));
+    memcpy(gradient, next_gradient, sizeof(next_gradient));
+    memcpy(hessian, next_hessian, sizeof(next_hessian));
+  }
+}
+
+// Set [view] to [hll] if it is dense with [precision], otherwise
+// merge [hll] in [tmp] and set [view] to it
+HLL_DEF hll_error _hll_dense_view(hll_t *hll,
+                                  unsigned int precision,
+                                  hll_t *tmp,
+                                  hll_t **view)
+{
+  if (hll->representation == HLL_REPRESENTATION_DENSE
+      && hll->precision == precision)
+  {
+    *view = hll;
+    return HLL_OK;
+  }
+
+  hll_error err = hll_init(tmp,
+                           .precision = precision,
+                           .register_bits = 8,
+                           .representation = HLL_REPRESENTATION_DENSE);
+  if (err != HLL_OK)
+    return err;
+  if ((err = hll_merge(tmp, hll)) != HLL_OK)
+  {
+    hll_destroy(tmp);
+    return err;
+  }
+  *view = tmp;
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_count_joint(hll_t *hll_a,
+                                  hll_t *hll_b,
+                                  hll_joint_t *joint)
+{
+  if (hll_a == NULL || hll_b == NULL || joint == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (hll_a->representation == 0 || hll_b->representation == 0)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  const unsigned int precision = (hll_a->precision < hll_b->precision)
+    ? hll_a->precision : hll_b->precision;
+  hll_t tmp_a, tmp_b;
+  hll_t *a, *b;
+  hll_error err = _hll_dense_view(hll_a, precision, &tmp_a, &a);
+  if (err != HLL_OK)
+    return err;
+  if ((err = _hll_dense_view(hll_b, precision, &tmp_b, &b)) != HLL_OK)
+  {
+    if (a == &tmp_a)
+      hll_destroy(&tmp_a);
+    return err;
+  }
+
+  _hll_joint_histograms_t h = {0};
+  h.precision = precision;
+  const unsigned int registers_len = 1u << precision;
+  for (unsigned int i = 0; i < registers_len; ++i)
+  {
+    unsigned int ka = (a->register_bits == 8) ? a->_registers[i]
+                                              : hll_get_register(a, i);
+    unsigned int kb = (b->register_bits == 8) ? b->_registers[i]
+                                              : hll_get_register(b, i);
+    ka &= HLL_REGISTER_MAX;
+    kb &= HLL_REGISTER_MAX;
+    if (ka < kb)
+    {
+      h.less_a[ka]++;
+      h.less_b[kb]++;
+    } else if (ka > kb)
+    {
+      h.greater_a[ka]++;
+      h.greater_b[kb]++;
+    } else {
+      h.equal[ka]++;
+    }
+  }
+
+  if (a == &tmp_a)
+    hll_destroy(&tmp_a);
+  if (b == &tmp_b)
+    hll_destroy(&tmp_b);
+
+  *joint = (hll_joint_t){0};
+  if (h.equal[0] == registers_len)
+    return HLL_OK;
+
+  // Start from inclusion-exclusion of the estimates of A, B and of
+  // their union
+  unsigned int histogram_a[HLL_REGISTER_MAX + 1];
+  unsigned int histogram_b[HLL_REGISTER_MAX + 1];
+  unsigned int histogram_union[HLL_REGISTER_MAX + 1];
+  for (unsigned int k = 0; k <= HLL_REGISTER_MAX; ++k)
+  {
+    histogram_a[k] = h.less_a[k] + h.greater_a[k] + h.equal[k];
+    histogram_b[k] = h.less_b[k] + h.greater_b[k] + h.equal[k];
+    histogram_union[k] = h.less_b[k] + h.greater_a[k] + h.equal[k];
+  }
+  double count_a = (double)_hll_estimate_ertl(precision, histogram_a);
+  double count_b = (double)_hll_estimate_ertl(precision, histogram_b);
+  double count_union = (double)_hll_estimate_ertl(precision,
+                                                  histogram_union);
+  double start[3] = {
+    count_union - count_b,
+    count_union - count_a,
+    count_a + count_b - count_union,
+  };
+  double rates[3];
+  for (unsigned int i = 0; i < 3; ++i)
+    rates[i] = ((start[i] > 1) ? start[i] : 1) / registers_len;
+
+  _hll_joint_maximize(&h, rates);
+
+  double means[3];
+  for (unsigned int i = 0; i < 3; ++i)
+    means[i] = rates[i] * registers_len;
+
+  joint->a_only       = (long long)(means[0] + 0.5);
+  joint->b_only       = (long long)(means[1] + 0.5);
+  joint->intersection = (long long)(means[2] + 0.5);
+  joint->total = (long long)(means[0] + means[1] + means[2] + 0.5);
+  joint->jaccard = means[2] / (means[0] + means[1] + means[2]);
+
+  return HLL_OK;
+}
+
+HLL_DEF long long hll_count_intersection(hll_t *hll_a, hll_t *hll_b)
+{
+  hll_joint_t joint;
+  hll_error err = hll_count_joint(hll_a, hll_b, &joint);
+  if (err != HLL_OK)
+    return err;
+  return joint.intersection;
+}
+
+// Every chunk and every arena allocation starts with a header of
+// _HLL_ARENA_HEADER bytes, which keeps the allocations aligned
+#define _HLL_ARENA_HEADER 16
+#define _HLL_ARENA_ROUND(len) \
+  (((len) + _HLL_ARENA_HEADER - 1) / _HLL_ARENA_HEADER * _HLL_ARENA_HEADER)
+
+typedef struct _hll_arena_chunk {
+  struct _hll_arena_chunk *next;
+} _hll_arena_chunk_t;
+
+HLL_DEF void *_hll_arena_calloc(void *ctx, size_t count, size_t size)
+{
+  hll_arena_t *arena = ctx;
+  if (size != 0 && count > (size_t)-1 / size / 2)
+    return NULL;
+
+  size_t len = count * size;
+  if (len <= arena->block_size && arena->_free_blocks != NULL)
+  {
+    unsigned char *block = arena->_free_blocks;
+    arena->_free_blocks = *(void**)block;
+    memset(block, 0, arena->block_size);
+    return block;
+  }
+
+  // The size is stored in the header to recognize blocks when freed
+  if (len < arena->block_size)
+    len = arena->block_size;
+  const size_t stride = _HLL_ARENA_HEADER + _HLL_ARENA_ROUND(len);
+  const size_t capacity = _HLL_ARENA_HEADER + arena->chunk_blocks
+    * (_HLL_ARENA_HEADER + _HLL_ARENA_ROUND(arena->block_size));
+
+  unsigned char *header;
+  if (stride > capacity - _HLL_ARENA_HEADER)
+  {
+    _hll_arena_chunk_t *large = HLL_CALLOC(_HLL_ARENA_HEADER + stride, 1);
+    if (large == NULL)
+      return NULL;
+    large->next = arena->_large;
+    arena->_large = large;
+    header = (unsigned char*)large + _HLL_ARENA_HEADER;
+    *(size_t*)header = len;
+    return header + _HLL_ARENA_HEADER;
+  }
+
+  _hll_arena_chunk_t *chunk = arena->_current;
+  if (chunk == NULL || arena->_used + stride > capacity)
+  {
+    // Move to the next chunk, kept from before a reset or new
+    _hll_arena_chunk_t *next = chunk ? chunk->next : arena->_chunks;
+    if (next == NULL)
+    {
+      next = HLL_CALLOC(capacity, 1);
+      if (next == NULL)
+        return NULL;
+      if (chunk != NULL)
+        chunk->next = next;
+      else
+        arena->_chunks = next;
+    }
+    arena->_current = next;
+    arena->_used = _HLL_ARENA_HEADER;
+    chunk = next;
+  }
+
+  header = (unsigned char*)chunk + arena->_used;
+  arena->_used += stride;
+  *(size_t*)header = len;
+  memset(header + _HLL_ARENA_HEADER, 0, stride - _HLL_ARENA_HEADER);
+  return header + _HLL_ARENA_HEADER;
+}
+
+HLL_DEF void _hll_arena_free(void *ctx, void *ptr)
+{
+  hll_arena_t *arena = ctx;
+  if (ptr == NULL)
+    return;
+
+  // Only blocks are reused, other allocations wait for
+  // hll_arena_release
+  if (*(size_t*)((unsigned char*)ptr - _HLL_ARENA_HEADER)
+      == arena->block_size)
+  {
+    *(void**)ptr = arena->_free_blocks;
+    arena->_free_blocks = ptr;
+  }
+}
+
+HLL_DEF hll_error hll_arena_init(hll_arena_t *arena,
+                                 size_t block_size,
+                                 size_t chunk_blocks)
+{
+  if (arena == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  // A free block stores the next free block
+  if (block_size < sizeof(void*))
+    block_size = sizeof(void*);
+
+  *arena = (hll_arena_t) {
+    .allocator = {
+      .calloc = _hll_arena_calloc,
+      .free   = _hll_arena_free,
+      .ctx    = arena,
+    },
+    .block_size   = block_size,
+    .chunk_blocks = chunk_blocks ? chunk_blocks : 64,
+  };
+
+  return HLL_OK;
+}
+
+// Free a list of arena chunks
+HLL_DEF void _hll_arena_free_chunks(_hll_arena_chunk_t *chunk)
+{
+  while (chunk != NULL)
+  {
+    _hll_arena_chunk_t *next = chunk->next;
+    HLL_FREE(chunk);
+    chunk = next;
+  }
+}
+
+HLL_DEF hll_error hll_arena_reset(hll_arena_t *arena)
+{
+  if (arena == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  _hll_arena_free_chunks(arena->_large);
+  arena->_large = NULL;
+  arena->_current = NULL;
+  arena->_used = 0;
+  arena->_free_blocks = NULL;
+
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_arena_release(hll_arena_t *arena)
+{
+  if (arena == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  hll_arena_reset(arena);
+  _hll_arena_free_chunks(arena->_chunks);
+  arena->_chunks = NULL;
+
+  return HLL_OK;
+}
+
+#define _HLL_SHARD(sharded, shard) \
+  ((hll_shard_t*)((sharded)->_shards + (size_t)(shard) * (sharded)->_stride))
+
+HLL_DEF hll_error _hll_sharded_init_impl(hll_sharded_t *sharded,
+                                         unsigned int shards,
+                                         hll_t *hll_src)
+{
+  if (sharded == NULL || hll_src == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  sharded->_memory = NULL;
+  if (shards == 0)
+    return HLL_ERROR_INVALID_SLOT;
+
+  hll_t settings = *hll_src;
+  settings.representation = HLL_REPRESENTATION_DENSE;
+  settings.concurrent = 0;
+  settings.cached = 0;
+  settings.track_changes = 0;
+  hll_error err = _hll_init_impl(&sharded->_merged, &settings);
+  if (err != HLL_OK)
+    return err;
+
+  // The registers of a shard follow its header, both padded to
+  // HLL_CACHE_LINE so no two shards share a cache line
+  const size_t header_size =
+    (sizeof(hll_shard_t) + HLL_CACHE_LINE - 1)
+    / HLL_CACHE_LINE * HLL_CACHE_LINE;
+  const size_t registers_size =
+    (HLL_REGISTERS_SIZE(sharded->_merged.precision,
+                        sharded->_merged.register_bits)
+     + HLL_CACHE_LINE - 1) / HLL_CACHE_LINE * HLL_CACHE_LINE;
+  sharded->_stride = header_size + registers_size;
+  sharded->_memory = _hll_calloc(&sharded->_merged,
+                                 shards * sharded->_stride
+                                 + HLL_CACHE_LINE - 1, 1);
+  if (sharded->_memory == NULL)
+  {
+    hll_destroy(&sharded->_merged);
+    return HLL_ERROR_ALLOCATING_MEMORY;
+  }
+
+  sharded->_shards = sharded->_memory
+    + (HLL_CACHE_LINE - (uintptr_t)sharded->_memory % HLL_CACHE_LINE)
+      % HLL_CACHE_LINE;
+  sharded->shards = shards;
+  sharded->_count = 0;
+  for (unsigned int i = 0; i < shards; ++i)
+  {
+    hll_shard_t *shard = _HLL_SHARD(sharded, i);
+    shard->hll = sharded->_merged;
+    shard->hll._registers = (unsigned char*)shard + header_size;
+    shard->hll._flags = _HLL_FLAG_BORROWED;
+    shard->dirty = 0;
+  }
+
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_sharded_destroy(hll_sharded_t *sharded)
+{
+  if (sharded == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (sharded->_memory == NULL)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  _hll_free(&sharded->_merged, sharded->_memory);
+  sharded->_memory = NULL;
+  sharded->_shards = NULL;
+  sharded->shards = 0;
+
+  return hll_destroy(&sharded->_merged);
+}
+
+HLL_DEF hll_error hll_sharded_add(hll_sharded_t *sharded,
+                                  unsigned int shard,
+                                  hll_element_t element,
+                                  unsigned int element_len)
+{
+  if (sharded == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (sharded->_memory == NULL)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  if (shard >= sharded->shards)
+    return HLL_ERROR_INVALID_SLOT;
+
+  // Shards are dense, only a raised register changes the union
+  hll_shard_t *s = _HLL_SHARD(sharded, shard);
+  if (_hll_dense_add_hash(&s->hll, _HLL_HASH(&s->hll, element, element_len)))
+    s->dirty = 1;
+
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_sharded_add_many(hll_sharded_t *sharded,
+                                       unsigned int shard,
+                                       const hll_element_t *elements,
+                                       const unsigned int *lengths,
+                                       unsigned int n)
+{
+  if (sharded == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (sharded->_memory == NULL)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  if (shard >= sharded->shards)
+    return HLL_ERROR_INVALID_SLOT;
+
+  if (n > 0 && (elements == NULL || lengths == NULL))
+    return HLL_ERROR_HLL_NULL;
+
+  hll_shard_t *s = _HLL_SHARD(sharded, shard);
+  hll_hash_t hashes[HLL_BATCH_LEN];
+  unsigned int updates = 0;
+  for (unsigned int i = 0; i < n; i += HLL_BATCH_LEN)
+  {
+    unsigned int len = (n - i < HLL_BATCH_LEN) ? n - i : HLL_BATCH_LEN;
+    for (unsigned int j = 0; j < len; ++j)
+      hashes[j] = _HLL_HASH(&s->hll, elements[i + j], lengths[i + j]);
+    updates += _hll_dense_add_hashes(&s->hll, hashes, len);
+  }
+  if (updates > 0)
+    s->dirty = 1;
+
+  return HLL_OK;
+}
+
+HLL_DEF long long hll_sharded_count(hll_sharded_t *sharded)
+{
+  if (sharded == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (sharded->_memory == NULL)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  // Shards keep their registers, so a changed shard only needs to be
+  // merged again in the union
+  int changed = 0;
+  for (unsigned int i = 0; i < sharded->shards; ++i)
+  {
+    hll_shard_t *s = _HLL_SHARD(sharded, i);
+    if (!s->dirty)
+      continue;
+    hll_error err = hll_merge(&sharded->_merged, &s->hll);
+    if (err != HLL_OK)
+      return err;
+    s->dirty = 0;
+    changed = 1;
+  }
+
+  if (changed)
+    sharded->_count = hll_count(&sharded->_merged);
+
+  return sharded->_count;
+}
+
+HLL_DEF hll_error _hll_window_init_impl(hll_window_t *window,
+                                        unsigned int precision,
+                                        uint32_t horizon,
+                                        hll_hash_func_t hash,
+                                        const hll_allocator_t *allocator)
+{
+  if (window == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  *window = (hll_window_t){0};
+  if (precision < HLL_PRECISION_MIN || precision > HLL_PRECISION_MAX)
+    return HLL_ERROR_INVALID_PRECISION;
+
+  // _hll_calloc and _hll_free take the allocator from an hll
+  const hll_t *alloc = &(hll_t){ .allocator = allocator };
+  const size_t registers_len = (size_t)1 << precision;
+  *window = (hll_window_t) {
+    ._times    = _hll_calloc(alloc, registers_len * HLL_WINDOW_DEPTH,
+                             sizeof(uint32_t)),
+    ._ranks    = _hll_calloc(alloc, registers_len * HLL_WINDOW_DEPTH, 1),
+    ._lens     = _hll_calloc(alloc, registers_len, 1),
+    .precision = precision,
+    .hash      = hash,
+    .horizon   = horizon,
+    .allocator = allocator,
+  };
+  if (window->_times == NULL || window->_ranks == NULL
+      || window->_lens == NULL)
+  {
+    hll_window_destroy(window);
+    return HLL_ERROR_ALLOCATING_MEMORY;
+  }
+
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_window_destroy(hll_window_t *window)
+{
+  if (window == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  const hll_t *alloc = &(hll_t){ .allocator = window->allocator };
+  if (window->_times != NULL)
+    _hll_free(alloc, window->_times);
+  if (window->_ranks != NULL)
+    _hll_free(alloc, window->_ranks);
+  if (window->_lens != NULL)
+    _hll_free(alloc, window->_lens);
+  *window = (hll_window_t){0};
+
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_window_add_hash(hll_window_t *window,
+                                      hll_hash_t hash,
+                                      uint32_t timestamp)
+{
+  if (window == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (window->_lens == NULL)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  if (timestamp > window->_now)
+    window->_now = timestamp;
+  timestamp = window->_now;
+
+  unsigned int offset = sizeof(hll_hash_t)*8 - window->precision;
+  unsigned int idx    = (unsigned int)(hash >> offset);
+  unsigned char rank  =
+    (unsigned char)(hll_get_hash_zeros(hash, window->precision) + 1);
+
+  uint32_t *times      = window->_times + (size_t)idx * HLL_WINDOW_DEPTH;
+  unsigned char *ranks = window->_ranks + (size_t)idx * HLL_WINDOW_DEPTH;
+  unsigned int len     = window->_lens[idx];
+
+  // Pairs with a rank not bigger than the new one can not be a
+  // maximum anymore, they are at the end of the list
+  while (len > 0 && ranks[len - 1] <= rank)
+    len--;
+
+  // Drop the pairs out of the horizon, and the oldest pair if the
+  // list is full
+  unsigned int first = 0;
+  while (first < len && timestamp - times[first] >= window->horizon)
+    first++;
+  if (len - first == HLL_WINDOW_DEPTH)
+    first++;
+  if (first > 0)
+  {
+    for (unsigned int i = first; i < len; ++i)
+    {
+      times[i - first] = times[i];
+      ranks[i - first] = ranks[i];
+    }
+    len -= first;
+  }
+
+  times[len] = timestamp;
+  ranks[len] = rank;
+  window->_lens[idx] = (unsigned char)(len + 1);
+
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_window_add(hll_window_t *window,
+                                 hll_element_t element,
+                                 unsigned int element_len,
+                                 uint32_t timestamp)
+{
+  if (window == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (window->_lens == NULL)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  return hll_window_add_hash(window,
+                             _HLL_HASH(window, element, element_len),
+                             timestamp);
+}
+
+HLL_DEF long long hll_count_window(const hll_window_t *window,
+                                   uint32_t window_len)
+{
+  if (window == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (window->_lens == NULL)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  if (window_len > window->horizon)
+    window_len = window->horizon;
+
+  // The register value of the window is the rank of its oldest pair
+  const unsigned int registers_len = 1u << window->precision;
+  double sum = 0.0;
+  unsigned int zeros = 0;
+  for (unsigned int idx = 0; idx < registers_len; ++idx)
+  {
+    const uint32_t *times      = window->_times
+                                 + (size_t)idx * HLL_WINDOW_DEPTH;
+    const unsigned char *ranks = window->_ranks
+                                 + (size_t)idx * HLL_WINDOW_DEPTH;
+    unsigned int len           = window->_lens[idx];
+    unsigned int i = 0;
+    while (i < len && window->_now - times[i] >= window_len)
+      i++;
+
+    unsigned int rank = (i < len) ? ranks[i] : 0;
+    sum   += _hll_inverse_powers[rank];
+    zeros += (rank == 0);
+  }
+
+  return _hll_estimate(window->precision, sum, zeros);
+}
+
+HLL_DEF hll_error _hll_table_init_impl(hll_table_t *table,
+                                       uint32_t rows,
+                                       hll_t *hll_src)
+{
+  if (table == NULL || hll_src == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  *table = (hll_table_t){0};
+  if (rows == 0)
+    return HLL_ERROR_INVALID_SLOT;
+
+  hll_t row = *hll_src;
+  row.representation = HLL_REPRESENTATION_DENSE;
+  row.concurrent = 0;
+  row.cached = 0;
+  row.track_changes = 0;
+  hll_error err = _hll_init_settings(&row);
+  if (err != HLL_OK)
+    return err;
+
+  const uint32_t row_size = HLL_REGISTERS_SIZE(row.precision,
+                                               row.register_bits);
+  unsigned char *registers = _hll_calloc(&row, rows, row_size);
+  if (registers == NULL)
+    return HLL_ERROR_ALLOCATING_MEMORY;
+
+  *table = (hll_table_t) {
+    ._registers = registers,
+    .rows       = rows,
+    .row_size   = row_size,
+    ._row       = row,
+  };
+
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_table_destroy(hll_table_t *table)
+{
+  if (table == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (table->_registers != NULL)
+    _hll_free(&table->_row, table->_registers);
+  *table = (hll_table_t){0};
+
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_table_get(hll_table_t *table,
+                                uint32_t key_id,
+                                hll_t *hll)
+{
+  if (table == NULL || hll == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (table->_registers == NULL)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  if (key_id >= table->rows)
+    return HLL_ERROR_INVALID_SLOT;
+
+  *hll = table->_row;
+  hll->_registers = table->_registers + (size_t)key_id * table->row_size;
+  hll->_flags = _HLL_FLAG_BORROWED;
+
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_table_add_hash(hll_table_t *table,
+                                     uint32_t key_id,
+                                     hll_hash_t hash)
+{
+  if (table == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (table->_registers == NULL)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  if (key_id >= table->rows)
+    return HLL_ERROR_INVALID_SLOT;
+
+  const unsigned int precision = table->_row.precision;
+  unsigned int idx  = (unsigned int)(hash >> (sizeof(hll_hash_t)*8
+                                              - precision));
+  unsigned int rank = hll_get_hash_zeros(hash, precision) + 1;
+  if (table->_row.register_bits == 8)
+  {
+    // The common case skips building an hll for the row
+    unsigned char *reg = table->_registers
+      + (size_t)key_id * table->row_size + idx;
+    if (rank > HLL_REGISTER_MAX)
+      rank = HLL_REGISTER_MAX;
+    if (rank > *reg)
+      *reg = (unsigned char)rank;
+    return HLL_OK;
+  }
+
+  hll_t row;
+  hll_table_get(table, key_id, &row);
+  _hll_register_update(&row, idx, rank);
+
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_table_add(hll_table_t *table,
+                                uint32_t key_id,
+                                hll_element_t element,
+                                unsigned int element_len)
+{
+  if (table == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (table->_registers == NULL)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  return hll_table_add_hash(table, key_id,
+                            _HLL_HASH(&table->_row, element, element_len));
+}
+
+HLL_DEF long long hll_table_count(hll_table_t *table, uint32_t key_id)
+{
+  hll_t row;
+  hll_error err = hll_table_get(table, key_id, &row);
+  if (err != HLL_OK)
+    return err;
+
+  return _hll_count(&row);
+}
+
+HLL_DEF hll_error hll_table_merge(hll_table_t *table_dest,
+                                  hll_table_t *table_src)
+{
+  if (table_dest == NULL || table_src == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (table_dest->_registers == NULL || table_src->_registers == NULL)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  if (table_dest->_row.precision != table_src->_row.precision
+      || table_dest->_row.register_bits != table_src->_row.register_bits)
+    return HLL_ERROR_PRECISION_MISMATCH;
+
+  if (table_dest->rows != table_src->rows)
+    return HLL_ERROR_INVALID_SLOT;
+
+  if (table_dest == table_src)
+    return HLL_OK;
+
+  if (table_dest->_row.register_bits == 8)
+  {
+    // Rows are contiguous, the matrix merges like one big hll
+    const size_t size = (size_t)table_dest->rows * table_dest->row_size;
+    for (size_t start = 0; start < size; start += 1u << 30)
+    {
+      size_t len = size - start;
+      if (len > 1u << 30)
+        len = 1u << 30;
+      _hll_registers_max(table_dest->_registers + start,
+                         table_src->_registers + start, (unsigned int)len);
+    }
+    return HLL_OK;
+  }
+
+  hll_t dest, src;
+  for (uint32_t key_id = 0; key_id < table_dest->rows; ++key_id)
+  {
+    hll_table_get(table_dest, key_id, &dest);
+    hll_table_get(table_src, key_id, &src);
+    _hll_merge(&dest, &src);
+  }
+
+  return HLL_OK;
+}
+
+// Whether hll_add hashes the elements of [hll] like hll_hash_bytes
+// hashes the records of a stream
+HLL_DEF int _hll_stream_hash_matches(const hll_t *hll)
+{
+  if (hll->hash_id != HLL_HASH_ID_XXH64)
+    return 0;
+#ifdef HLL_HASH_INLINE
+  return (hll_hash_func_t)HLL_HASH_FUNC
+    == (hll_hash_func_t)hll_hash_string64;
+#else
+  return hll->hash == (hll_hash_func_t)hll_hash_string64;
+#endif
+}
+
+HLL_DEF hll_error hll_stream_init(hll_stream_t *stream,
+                                  hll_t *hll,
+                                  unsigned char delimiter)
+{
+  if (stream == NULL || hll == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (hll->representation == 0)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  if (!_hll_stream_hash_matches(hll))
+    return HLL_ERROR_HASH_MISMATCH;
+
+  *stream = (hll_stream_t){
+    .hll       = hll,
+    .delimiter = delimiter,
+    .hash      = hll_hash_bytes,
+  };
+
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_stream_init_fixed(hll_stream_t *stream,
+                                        hll_t *hll,
+                                        unsigned int record_len)
+{
+  if (stream == NULL || hll == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (hll->representation == 0)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  if (!_hll_stream_hash_matches(hll))
+    return HLL_ERROR_HASH_MISMATCH;
+
+  if (record_len == 0)
+    return HLL_ERROR_INVALID_FORMAT;
+
+  *stream = (hll_stream_t){
+    .hll        = hll,
+    .record_len = record_len,
+    .hash       = hll_hash_bytes,
+  };
+
+  return HLL_OK;
+}
+
+// Append [len] bytes to the partial record of a stream
+HLL_DEF hll_error _hll_stream_carry(hll_stream_t *stream,
+                                    const unsigned char *bytes,
+                                    unsigned int len)
+{
+  if (stream->_carry_len + len > stream->_carry_cap)
+  {
+    unsigned int cap = (stream->_carry_cap > 0) ? stream->_carry_cap : 64;
+    while (cap < stream->_carry_len + len)
+      cap *= 2;
+    unsigned char *carry = _hll_calloc(stream->hll, cap, 1);
+    if (carry == NULL)
+      return HLL_ERROR_ALLOCATING_MEMORY;
+    if (stream->_carry_len > 0)
+      memcpy(carry, stream->_carry, stream->_carry_len);
+    if (stream->_carry != NULL)
+      _hll_free(stream->hll, stream->_carry);
+    stream->_carry     = carry;
+    stream->_carry_cap = cap;
+  }
+  memcpy(stream->_carry + stream->_carry_len, bytes, len);
+  stream->_carry_len += len;
+
+  return HLL_OK;
+}
+
+// Hash a record in the batch of [n] hashes of a stream, and insert
+// the batch when it is full. Returns the error of the insertion.
+#define _HLL_STREAM_RECORD(stream, hashes, n, record, record_len)      \
+  do {                                                                 \
+    (hashes)[(n)++] = (hll_hash_t)(stream)->hash(record, record_len);  \
+    if ((n) == HLL_BATCH_LEN)                                          \
+    {                                                                  \
+      hll_error _err = _hll_add_hashes((stream)->hll, hashes, n);      \
+      if (_err != HLL_OK)                                              \
+        return _err;                                                   \
+      (n) = 0;                                                         \
+    }                                                                  \
+  } while (0)
+
+HLL_DEF hll_error hll_stream_feed(hll_stream_t *stream,
+                                  const void *chunk,
+                                  size_t chunk_len)
+{
+  if (stream == NULL || stream->hll == NULL
+      || (chunk_len > 0 && chunk == NULL))
+    return HLL_ERROR_HLL_NULL;
+
+  hll_t *hll = stream->hll;
+  const unsigned char *bytes = (const unsigned char*)chunk;
+  const unsigned char *end = bytes + chunk_len;
+  hll_hash_t hashes[HLL_BATCH_LEN];
+  unsigned int n = 0;
+  hll_error err;
+
+  if (stream->record_len > 0)
+  {
+    const size_t record_len = stream->record_len;
+    if (stream->_carry_len > 0)
+    {
+      size_t missing = record_len - stream->_carry_len;
+      if (chunk_len < missing)
+        return _hll_stream_carry(stream, bytes, (unsigned int)chunk_len);
+      if ((err = _hll_stream_carry(stream, bytes,
+                                   (unsigned int)missing)) != HLL_OK)
+        return err;
+      _HLL_STREAM_RECORD(stream, hashes, n, stream->_carry, record_len);
+      stream->_carry_len = 0;
+      bytes += missing;
+    }
+    for (; (size_t)(end - bytes) >= record_len; bytes += record_len)
+      _HLL_STREAM_RECORD(stream, hashes, n, bytes, record_len);
+  } else {
+    const unsigned char *delimiter;
+    while ((delimiter = memchr(bytes, stream->delimiter,
+                               (size_t)(end - bytes))) != NULL)
+    {
+      if (stream->_carry_len > 0)
+      {
+        if ((err = _hll_stream_carry(stream, bytes,
+                                     (unsigned int)(delimiter - bytes)))
+            != HLL_OK)
+          return err;
+        _HLL_STREAM_RECORD(stream, hashes, n, stream->_carry,
+                           stream->_carry_len);
+        stream->_carry_len = 0;
+      } else if (delimiter > bytes) {
+        _HLL_STREAM_RECORD(stream, hashes, n, bytes, delimiter - bytes);
+      }
+      bytes = delimiter + 1;
+    }
+  }
+
+  if (n > 0 && (err = _hll_add_hashes(hll, hashes, n)) != HLL_OK)
+    return err;
+
+  if (bytes < end)
+    return _hll_stream_carry(stream, bytes, (unsigned int)(end - bytes));
+
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_stream_finish(hll_stream_t *stream)
+{
+  if (stream == NULL || stream->hll == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  hll_error err = HLL_OK;
+  if (stream->_carry_len > 0)
+  {
+    if (stream->record_len > 0)
+      err = HLL_ERROR_INVALID_FORMAT;
+    else
+      err = _hll_add_hash(stream->hll,
+                          (hll_hash_t)stream->hash(stream->_carry,
+                                                   stream->_carry_len));
+  }
+
+  if (stream->_carry != NULL)
+    _hll_free(stream->hll, stream->_carry);
+  *stream = (hll_stream_t){0};
+
+  return err;
+}
+
+// hash [bytes] of size [len]
+// Credits to http://www.cse.yorku.ca/~oz/hash.html
+HLL_DEF unsigned int hll_hash_string(char *bytes, unsigned int len)
+{
+  unsigned int hash = 5381;
+  for (unsigned int i = 0; i < len; ++i)
+    hash = hash * 33 + bytes[i];
+  return hash;
+}
+
+HLL_DEF hll_error hll_serialize(hll_t *hll,
+                                void *buffer,
+                                size_t buffer_len,
+                                size_t *written)
+{
+  if (hll == NULL || written == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (hll->representation == 0)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  hll_error err;
+  if (hll->representation == HLL_REPRESENTATION_SPARSE
+      && (err = _hll_sparse_flush(hll)) != HLL_OK)
+    return err;
+
+  const int sparse = (hll->representation == HLL_REPRESENTATION_SPARSE);
+  const uint32_t payload_len = sparse
+    ? hll->_sparse.list_len
+    : HLL_REGISTERS_SIZE(hll->precision, hll->register_bits);
+  const unsigned char *payload = sparse ? hll->_sparse.list : hll->_registers;
+
+  *written = HLL_SERIALIZED_HEADER_SIZE + payload_len;
+  if (buffer == NULL)
+    return HLL_OK;
+  if (buffer_len < *written)
+    return HLL_ERROR_BUFFER_TOO_SMALL;
+
+  unsigned char *out = (unsigned char*)buffer;
+  out[0] = 'H';
+  out[1] = 'L';
+  out[2] = 'L';
+  out[3] = HLL_SERIALIZED_VERSION;
+  out[4] = (unsigned char)hll->precision;
+  out[5] = (unsigned char)hll->representation;
+  out[6] = (unsigned char)hll->register_bits;
+  out[7] = (unsigned char)(sizeof(hll_hash_t) * 8);
+  _HLL_WRITE32(out + 8, hll->hash_id);
+  _HLL_WRITE32(out + 12, sparse ? hll->_sparse.list_count : 0u);
+  _HLL_WRITE32(out + 16, payload_len);
+  for (uint32_t i = 0; i < payload_len; ++i)
+    out[HLL_SERIALIZED_HEADER_SIZE + i] = payload[i];
+
+  return HLL_OK;
+}
+
+// Check that a sparse list holds [count] entries in exactly [len]
+// bytes, with strictly increasing indexes
+HLL_DEF hll_error _hll_sparse_validate(const unsigned char *list,
+                                       uint32_t len,
+                                       uint32_t count)
+{
+  uint32_t pos = 0, entry = 0;
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    uint32_t delta = 0;
+    unsigned int shift = 0;
+    unsigned char byte;
+    do {
+      if (pos >= len || shift > 28)
+        return HLL_ERROR_INVALID_FORMAT;
+      byte = list[pos++];
+      delta |= (uint32_t)(byte & 0x7F) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+
+    uint32_t next = entry + delta;
+    if (next < entry
+        || (i > 0 && (next >> 7) == (entry >> 7))
+        || (next >> 7) >= (1u << HLL_SPARSE_PRECISION))
+      return HLL_ERROR_INVALID_FORMAT;
+    entry = next;
+  }
+
+  return (pos == len) ? HLL_OK : HLL_ERROR_INVALID_FORMAT;
+}
+
+// Check that [len] 8 bit registers all hold at most HLL_REGISTER_MAX.
+// Returns 1 if they do, 0 otherwise.
+HLL_DEF int _hll_registers_valid(const unsigned char *registers,
+                                 size_t len)
+{
+  unsigned char bits = 0;
+  for (size_t i = 0; i < len; ++i)
+    bits |= registers[i];
+  return (bits & ~HLL_REGISTER_MAX) == 0;
+}
+
+HLL_DEF hll_error _hll_deserialize_impl(hll_t *hll,
+                                        const void *buffer,
+                                        size_t buffer_len,
+                                        void *view,
+                                        hll_hash_func_t hash,
+                                        uint32_t hash_id)
+{
+  if (hll == NULL)
+    return HLL_ERROR_HLL_NULL;
+  hll->representation = 0;
+  if (buffer == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  const unsigned char *in = (const unsigned char*)buffer;
+  if (buffer_len < HLL_SERIALIZED_HEADER_SIZE
+      || in[0] != 'H' || in[1] != 'L' || in[2] != 'L'
+      || in[3] != HLL_SERIALIZED_VERSION)
+    return HLL_ERROR_INVALID_FORMAT;
+
+  const unsigned int precision      = in[4];
+  const unsigned int representation = in[5];
+  const unsigned int register_bits  = in[6];
+  const uint32_t stored_hash_id     = _HLL_READ32(in + 8);
+  const uint32_t count              = _HLL_READ32(in + 12);
+  const uint32_t payload_len        = _HLL_READ32(in + 16);
+  const unsigned char *payload      = in + HLL_SERIALIZED_HEADER_SIZE;
+
+  if (precision < HLL_PRECISION_MIN || precision > HLL_PRECISION_MAX)
+    return HLL_ERROR_INVALID_PRECISION;
+  if (register_bits != 6 && register_bits != 8)
+    return HLL_ERROR_INVALID_REGISTER_BITS;
+  if (in[7] != sizeof(hll_hash_t) * 8
+      || (hash_id != HLL_HASH_ID_UNSPECIFIED
+          && stored_hash_id != HLL_HASH_ID_UNSPECIFIED
+          && hash_id != stored_hash_id))
+    return HLL_ERROR_HASH_MISMATCH;
+  if (payload_len > buffer_len - HLL_SERIALIZED_HEADER_SIZE)
+    return HLL_ERROR_INVALID_FORMAT;
+
+  hll_error err;
+  if (representation == HLL_REPRESENTATION_DENSE)
+  {
+    if (payload_len != HLL_REGISTERS_SIZE(precision, register_bits)
+        || count != 0)
+      return HLL_ERROR_INVALID_FORMAT;
+    // Packed 6 bit registers can not hold bigger values
+    if (register_bits == 8 && !_hll_registers_valid(payload, payload_len))
+      return HLL_ERROR_INVALID_FORMAT;
+  } else if (representation == HLL_REPRESENTATION_SPARSE) {
+    if ((err = _hll_sparse_validate(payload, payload_len, count)) != HLL_OK)
+      return err;
+  } else {
+    return HLL_ERROR_INVALID_REPRESENTATION;
+  }
+
+  *hll = (hll_t) {
+    .precision      = precision,
+    .hash           = hash,
+    .register_bits  = register_bits,
+    .representation = representation,
+    .hash_id        = stored_hash_id ? stored_hash_id : hash_id,
+  };
+
+  unsigned char *data = (view != NULL)
+    ? (unsigned char*)view + HLL_SERIALIZED_HEADER_SIZE
+    : NULL;
+  if (view == NULL && payload_len > 0)
+  {
+    data = HLL_CALLOC(payload_len, 1);
+    if (data == NULL)
+    {
+      hll->representation = 0;
+      return HLL_ERROR_ALLOCATING_MEMORY;
+    }
+    for (uint32_t i = 0; i < payload_len; ++i)
+      data[i] = payload[i];
+  }
+  if (view != NULL)
+    hll->_flags |= _HLL_FLAG_BORROWED;
+
+  if (representation == HLL_REPRESENTATION_DENSE)
+  {
+    hll->_registers = data;
+  } else {
+    hll->_sparse.list       = (count > 0) ? data : NULL;
+    hll->_sparse.list_len   = payload_len;
+    hll->_sparse.list_count = count;
+  }
+
+  return HLL_OK;
+}
+
+HLL_DEF hll_error _hll_view_impl(hll_t *hll,
+                                 void *buffer,
+                                 size_t buffer_len,
+                                 hll_hash_func_t hash,
+                                 uint32_t hash_id)
+{
+  return _hll_deserialize_impl(hll, buffer, buffer_len, buffer,
+                               hash, hash_id);
+}
+
+HLL_DEF hll_error hll_export_delta(hll_t *hll,
+                                   void *buffer,
+                                   size_t buffer_len,
+                                   size_t *written)
+{
+  if (hll == NULL || written == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (hll->representation == 0)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+  if (hll->representation != HLL_REPRESENTATION_DENSE)
+    return HLL_ERROR_INVALID_REPRESENTATION;
+
+  // First pass for the size, second pass to write the entries
+  const unsigned int registers_len = 1u << hll->precision;
+  const unsigned char *changes = hll->_changes;
+  unsigned char varint[5];
+  uint32_t entries = 0, payload_len = 0;
+  unsigned int prev = 0;
+  for (unsigned int idx = 0; idx < registers_len; ++idx)
+  {
+    if (changes != NULL && (idx & 7) == 0 && changes[idx >> 3] == 0)
+    {
+      idx += 7;
+      continue;
+    }
+    if ((changes != NULL && !(changes[idx >> 3] & (1u << (idx & 7))))
+        || hll_get_register(hll, idx) == 0)
+      continue;
+
+    unsigned int pos = 0;
+    _hll_varint_write(varint, &pos, idx - prev);
+    payload_len += pos + 1;
+    entries++;
+    prev = idx;
+  }
+
+  *written = HLL_DELTA_HEADER_SIZE + payload_len;
+  if (buffer == NULL)
+    return HLL_OK;
+  if (buffer_len < *written)
+    return HLL_ERROR_BUFFER_TOO_SMALL;
+
+  unsigned char *out = (unsigned char*)buffer;
+  out[0] = 'H';
+  out[1] = 'L';
+  out[2] = 'L';
+  out[3] = 'D';
+  out[4] = HLL_DELTA_VERSION;
+  out[5] = (unsigned char)hll->precision;
+  out[6] = (unsigned char)(sizeof(hll_hash_t) * 8);
+  out[7] = 0;
+  _HLL_WRITE32(out + 8, hll->hash_id);
+  _HLL_WRITE32(out + 12, entries);
+  _HLL_WRITE32(out + 16, payload_len);
+
+  unsigned char *payload = out + HLL_DELTA_HEADER_SIZE;
+  unsigned int pos = 0;
+  prev = 0;
+  for (unsigned int idx = 0; idx < registers_len; ++idx)
+  {
+    if (changes != NULL && (idx & 7) == 0 && changes[idx >> 3] == 0)
+    {
+      idx += 7;
+      continue;
+    }
+    unsigned int rank = hll_get_register(hll, idx);
+    if ((changes != NULL && !(changes[idx >> 3] & (1u << (idx & 7))))
+        || rank == 0)
+      continue;
+
+    _hll_varint_write(payload, &pos, idx - prev);
+    payload[pos++] = (unsigned char)rank;
+    prev = idx;
+  }
+
+  if (hll->_changes != NULL)
+    for (unsigned int i = 0; i < _HLL_CHANGES_SIZE(hll->precision); ++i)
+      hll->_changes[i] = 0;
+
+  return HLL_OK;
+}
+
+// Read the index and the value of a delta entry at [*pos], with
+// bounds checks. Returns HLL_ERROR_INVALID_FORMAT if the entry is
+// truncated or out of range.
+HLL_DEF hll_error _hll_delta_entry(const unsigned char *payload,
+                                   uint32_t payload_len,
+                                   uint32_t *pos,
+                                   unsigned int i,
+                                   unsigned int precision,
+                                   unsigned int *idx,
+                                   unsigned int *rank)
+{
+  uint32_t delta = 0;
+  unsigned int shift = 0;
+  unsigned char byte;
+  do {
+    if (*pos >= payload_len || shift > 28)
+      return HLL_ERROR_INVALID_FORMAT;
+    byte = payload[(*pos)++];
+    delta |= (uint32_t)(byte & 0x7F) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  if (*pos >= payload_len)
+    return HLL_ERROR_INVALID_FORMAT;
+
+  // Indexes are strictly increasing after the first entry
+  uint32_t next = *idx + delta;
+  if (next < *idx || (i > 0 && delta == 0) || next >= (1u << precision))
+    return HLL_ERROR_INVALID_FORMAT;
+  *idx  = next;
+  *rank = payload[(*pos)++];
+  if (*rank == 0 || *rank > HLL_REGISTER_MAX)
+    return HLL_ERROR_INVALID_FORMAT;
+
+  return HLL_OK;
+}
 
-HLL_DEF int hll_count(hll_t *hll)
+HLL_DEF hll_error hll_apply_delta(hll_t *hll,
+                                  const void *buffer,
+                                  size_t buffer_len)
 {
-  if (hll == NULL)
+  if (hll == NULL || buffer == NULL)
     return HLL_ERROR_HLL_NULL;
 
-  if (hll->_registers == NULL)
+  if (hll->representation == 0)
     return HLL_ERROR_HLL_UNINITIALIZED;
 
-  // Read the paper to understand what is happening
-  float magic = 0.0f;
-  unsigned int registers_len = (1 << hll->precision);
-  switch(registers_len)
-  {
-  case 16:
-    magic = 0.673;
-    break;
-  case 32:
-    magic = 0.697;
-    break;
-  case 64:
-    magic = 0.709;
-    break;
-  default:
-    magic = 0.7213 / (1 + 1.079 / (registers_len));
-    break;
-  }
-  
-  float sum = 0.0f;
-  for (unsigned int i = 0; i < registers_len - 1; ++i)
-    sum += HLL_POWF(2, -hll->_registers[i]);
+  const unsigned char *in = (const unsigned char*)buffer;
+  if (buffer_len < HLL_DELTA_HEADER_SIZE
+      || in[0] != 'H' || in[1] != 'L' || in[2] != 'L' || in[3] != 'D'
+      || in[4] != HLL_DELTA_VERSION || in[7] != 0)
+    return HLL_ERROR_INVALID_FORMAT;
 
-  float estimate = magic * registers_len * registers_len * (1 / sum);
-  if (estimate < 5 / 2 * registers_len)
-  {
-    unsigned int num_of_zero_registers = 0;
-    for (unsigned int i = 0; i < registers_len; ++i)
-      if (hll->_registers[i] == 0)
-        num_of_zero_registers++;
+  const unsigned int precision  = in[5];
+  const uint32_t stored_hash_id = _HLL_READ32(in + 8);
+  const uint32_t entries        = _HLL_READ32(in + 12);
+  const uint32_t payload_len    = _HLL_READ32(in + 16);
+  const unsigned char *payload  = in + HLL_DELTA_HEADER_SIZE;
 
-    if (num_of_zero_registers == 0)
-      return estimate;
+  if (precision != hll->precision)
+    return HLL_ERROR_PRECISION_MISMATCH;
+  if (in[6] != sizeof(hll_hash_t) * 8
+      || (hll->hash_id != HLL_HASH_ID_UNSPECIFIED
+          && stored_hash_id != HLL_HASH_ID_UNSPECIFIED
+          && hll->hash_id != stored_hash_id))
+    return HLL_ERROR_HASH_MISMATCH;
+  if (payload_len != buffer_len - HLL_DELTA_HEADER_SIZE
+      || entries > (1u << precision))
+    return HLL_ERROR_INVALID_FORMAT;
 
-    // Linear counting
-    return registers_len * HLL_LOGF(registers_len / num_of_zero_registers);
-  } else if (estimate <= (float)((1ULL << 32) / 30))
+  hll_error err;
+  uint32_t pos = 0;
+  unsigned int idx = 0, rank;
+  for (uint32_t i = 0; i < entries; ++i)
+    if ((err = _hll_delta_entry(payload, payload_len, &pos, i, precision,
+                                &idx, &rank)) != HLL_OK)
+      return err;
+  if (pos != payload_len)
+    return HLL_ERROR_INVALID_FORMAT;
+
+  if (hll->representation == HLL_REPRESENTATION_SPARSE
+      && entries > 0
+      && (err = _hll_sparse_to_dense(hll)) != HLL_OK)
+    return err;
+
+  pos = 0;
+  idx = 0;
+  unsigned long long updates = 0;
+  for (uint32_t i = 0; i < entries; ++i)
   {
-    return estimate;
-  } else {
-    return -(float)(1ULL << 32) * HLL_LOGF(1 - estimate / (float)(1ULL << 32));
+    _hll_delta_entry(payload, payload_len, &pos, i, precision, &idx, &rank);
+    updates += _hll_register_update(hll, idx, rank);
   }
-  
-  return 0;
+  _HLL_STAT_ADD(hll, register_updates, updates);
+
+  return HLL_OK;
 }
 
-hll_error hll_merge(hll_t *hll_dest, hll_t *hll_src)
-{
-  if (hll_dest == NULL || hll_src == NULL)
-    return HLL_ERROR_HLL_NULL;
+#define _HLL_XXH_PRIME1 0x9E3779B185EBCA87ULL
+#define _HLL_XXH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define _HLL_XXH_PRIME3 0x165667B19E3779F9ULL
+#define _HLL_XXH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define _HLL_XXH_PRIME5 0x27D4EB2F165667C5ULL
 
-  if (hll_dest->_registers == NULL || hll_src->_registers == NULL)
-    return HLL_ERROR_HLL_UNINITIALIZED;
+#define _HLL_ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
 
-  for (int i = 0;
-       i < (1 << hll_dest->precision)
-         && i < (1 << hll_src->precision);
-       ++i)
-    hll_dest->_registers[i] = hll_max(hll_dest->_registers[i],
-                                      hll_src->_registers[i]);
-  
-  return HLL_OK;
+HLL_DEF uint64_t _hll_xxh64_round(uint64_t acc, uint64_t input)
+{
+  acc += input * _HLL_XXH_PRIME2;
+  acc  = _HLL_ROTL64(acc, 31);
+  return acc * _HLL_XXH_PRIME1;
 }
 
-// hash [bytes] of size [len]
-// Credits to http://www.cse.yorku.ca/~oz/hash.html
-HLL_DEF unsigned int hll_hash_string(char *bytes, unsigned int len)
+HLL_DEF uint64_t _hll_xxh64_merge_round(uint64_t acc, uint64_t val)
 {
-  unsigned int hash = 5381;
-  for (unsigned int i = 0; i < len; ++i)
-    hash = hash * 33 + bytes[i];
+  acc ^= _hll_xxh64_round(0, val);
+  return acc * _HLL_XXH_PRIME1 + _HLL_XXH_PRIME4;
+}
+
+// XXH64 by Yann Collet, https://github.com/Cyan4973/xxHash
+HLL_DEF uint64_t hll_hash_bytes(const void *bytes, size_t len)
+{
+  const unsigned char *p   = (const unsigned char*)bytes;
+  const unsigned char *end = p + len;
+  uint64_t hash;
+
+  if (len >= 32)
+  {
+    uint64_t v1 = _HLL_XXH_PRIME1 + _HLL_XXH_PRIME2;
+    uint64_t v2 = _HLL_XXH_PRIME2;
+    uint64_t v3 = 0;
+    uint64_t v4 = 0 - _HLL_XXH_PRIME1;
+    do {
+      v1 = _hll_xxh64_round(v1, _HLL_READ64(p));
+      v2 = _hll_xxh64_round(v2, _HLL_READ64(p + 8));
+      v3 = _hll_xxh64_round(v3, _HLL_READ64(p + 16));
+      v4 = _hll_xxh64_round(v4, _HLL_READ64(p + 24));
+      p += 32;
+    } while (end - p >= 32);
+
+    hash = _HLL_ROTL64(v1, 1) + _HLL_ROTL64(v2, 7)
+      + _HLL_ROTL64(v3, 12) + _HLL_ROTL64(v4, 18);
+    hash = _hll_xxh64_merge_round(hash, v1);
+    hash = _hll_xxh64_merge_round(hash, v2);
+    hash = _hll_xxh64_merge_round(hash, v3);
+    hash = _hll_xxh64_merge_round(hash, v4);
+  } else {
+    hash = _HLL_XXH_PRIME5;
+  }
+
+  hash += (uint64_t)len;
+  for (; end - p >= 8; p += 8)
+  {
+    hash ^= _hll_xxh64_round(0, _HLL_READ64(p));
+    hash  = _HLL_ROTL64(hash, 27) * _HLL_XXH_PRIME1 + _HLL_XXH_PRIME4;
+  }
+  if (end - p >= 4)
+  {
+    hash ^= (uint64_t)_HLL_READ32(p) * _HLL_XXH_PRIME1;
+    hash  = _HLL_ROTL64(hash, 23) * _HLL_XXH_PRIME2 + _HLL_XXH_PRIME3;
+    p += 4;
+  }
+  for (; p < end; ++p)
+  {
+    hash ^= (uint64_t)(*p) * _HLL_XXH_PRIME5;
+    hash  = _HLL_ROTL64(hash, 11) * _HLL_XXH_PRIME1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= _HLL_XXH_PRIME2;
+  hash ^= hash >> 29;
+  hash *= _HLL_XXH_PRIME3;
+  hash ^= hash >> 32;
   return hash;
 }
 
-#if _HLL_ERROR_MAX != -5
+HLL_DEF hll_hash_t hll_hash_string64(char *input, unsigned int input_len)
+{
+  return (hll_hash_t)hll_hash_bytes(input, input_len);
+}
+
+#if _HLL_ERROR_MAX != -15
   #error "Updated HLL_ERRORs, should update hll_error_string"
 #endif
 HLL_DEF const char *hll_error_string(hll_error error)
@@ -507,6 +5719,26 @@ HLL_DEF const char *hll_error_string(hll_error error)
     return "HLL_ERROR_HLL_UNINITIALIZED";
   case HLL_ERROR_ALLOCATING_MEMORY:
     return "HLL_ERROR_ALLOCATING_MEMORY";
+  case HLL_ERROR_INVALID_REGISTER_BITS:
+    return "HLL_ERROR_INVALID_REGISTER_BITS";
+  case HLL_ERROR_INVALID_REPRESENTATION:
+    return "HLL_ERROR_INVALID_REPRESENTATION";
+  case HLL_ERROR_PRECISION_MISMATCH:
+    return "HLL_ERROR_PRECISION_MISMATCH";
+  case HLL_ERROR_BUFFER_TOO_SMALL:
+    return "HLL_ERROR_BUFFER_TOO_SMALL";
+  case HLL_ERROR_INVALID_FORMAT:
+    return "HLL_ERROR_INVALID_FORMAT";
+  case HLL_ERROR_HASH_MISMATCH:
+    return "HLL_ERROR_HASH_MISMATCH";
+  case HLL_ERROR_IO:
+    return "HLL_ERROR_IO";
+  case HLL_ERROR_INVALID_SLOT:
+    return "HLL_ERROR_INVALID_SLOT";
+  case HLL_ERROR_UNSUPPORTED:
+    return "HLL_ERROR_UNSUPPORTED";
+  case HLL_ERROR_INVALID_ESTIMATOR:
+    return "HLL_ERROR_INVALID_ESTIMATOR";
   default:
     break;
   }
@@ -514,6 +5746,684 @@ HLL_DEF const char *hll_error_string(hll_error error)
   return "HLL_ERROR_UNKNOWN";
 }
 
+#ifdef HLL_THREADS
+
+// Call [task] with each of the [n] arguments of [arg_size] bytes in
+// [args], each in its own thread. The last one runs in the calling
+// thread, and so does any task whose thread could not be created.
+HLL_DEF void _hll_threads_run(void *(*task)(void*),
+                              void *args,
+                              size_t arg_size,
+                              unsigned int n)
+{
+  pthread_t threads[HLL_THREADS_MAX];
+  int started[HLL_THREADS_MAX];
+  unsigned char *arg = (unsigned char*)args;
+  for (unsigned int i = 0; i + 1 < n; ++i)
+  {
+    started[i] = (pthread_create(&threads[i], NULL, task,
+                                 arg + i * arg_size) == 0);
+    if (!started[i])
+      task(arg + i * arg_size);
+  }
+  if (n > 0)
+    task(arg + (n - 1) * arg_size);
+  for (unsigned int i = 0; i + 1 < n; ++i)
+    if (started[i])
+      pthread_join(threads[i], NULL);
+}
+
+// Run the tasks of the current call of a pool until none is left to
+// start. Called and returns with the lock of the pool held.
+HLL_DEF void _hll_pool_work(hll_pool_t *pool)
+{
+  while (pool->_next < pool->_len)
+  {
+    void *(*task)(void*) = pool->_task;
+    void *arg = pool->_args + (size_t)pool->_next * pool->_arg_size;
+    pool->_next++;
+    pthread_mutex_unlock(&pool->_lock);
+    task(arg);
+    pthread_mutex_lock(&pool->_lock);
+    if (++pool->_finished == pool->_len)
+      pthread_cond_signal(&pool->_done);
+  }
+}
+
+// Thread of a pool, waits for tasks until the pool is destroyed
+HLL_DEF void *_hll_pool_worker(void *arg)
+{
+  hll_pool_t *pool = (hll_pool_t*)arg;
+  pthread_mutex_lock(&pool->_lock);
+  for (;;)
+  {
+    while (!pool->_stop && pool->_next >= pool->_len)
+      pthread_cond_wait(&pool->_work, &pool->_lock);
+    if (pool->_stop)
+      break;
+    _hll_pool_work(pool);
+  }
+  pthread_mutex_unlock(&pool->_lock);
+  return NULL;
+}
+
+HLL_DEF hll_error hll_pool_init(hll_pool_t *pool, unsigned int threads)
+{
+  if (pool == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (threads == 0)
+    threads = 1;
+  if (threads > HLL_THREADS_MAX)
+    threads = HLL_THREADS_MAX;
+
+  *pool = (hll_pool_t){ .threads = 1 };
+  if (pthread_mutex_init(&pool->_run, NULL) != 0)
+    return HLL_ERROR_ALLOCATING_MEMORY;
+  if (pthread_mutex_init(&pool->_lock, NULL) != 0)
+  {
+    pthread_mutex_destroy(&pool->_run);
+    return HLL_ERROR_ALLOCATING_MEMORY;
+  }
+  if (pthread_cond_init(&pool->_work, NULL) != 0)
+  {
+    pthread_mutex_destroy(&pool->_lock);
+    pthread_mutex_destroy(&pool->_run);
+    return HLL_ERROR_ALLOCATING_MEMORY;
+  }
+  if (pthread_cond_init(&pool->_done, NULL) != 0)
+  {
+    pthread_cond_destroy(&pool->_work);
+    pthread_mutex_destroy(&pool->_lock);
+    pthread_mutex_destroy(&pool->_run);
+    return HLL_ERROR_ALLOCATING_MEMORY;
+  }
+
+  // The calling thread is the last one
+  while (pool->threads < threads
+         && pthread_create(&pool->_workers[pool->threads - 1], NULL,
+                           _hll_pool_worker, pool) == 0)
+    pool->threads++;
+
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_pool_destroy(hll_pool_t *pool)
+{
+  if (pool == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (pool->threads == 0)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  pthread_mutex_lock(&pool->_lock);
+  pool->_stop = 1;
+  pthread_cond_broadcast(&pool->_work);
+  pthread_mutex_unlock(&pool->_lock);
+  for (unsigned int i = 0; i + 1 < pool->threads; ++i)
+    pthread_join(pool->_workers[i], NULL);
+
+  pthread_cond_destroy(&pool->_done);
+  pthread_cond_destroy(&pool->_work);
+  pthread_mutex_destroy(&pool->_lock);
+  pthread_mutex_destroy(&pool->_run);
+  pool->threads = 0;
+
+  return HLL_OK;
+}
+
+// Call [task] with each of the [n] arguments of [arg_size] bytes in
+// [args], with the threads of [pool] and the calling thread
+HLL_DEF void _hll_pool_run(hll_pool_t *pool,
+                           void *(*task)(void*),
+                           void *args,
+                           size_t arg_size,
+                           unsigned int n)
+{
+  pthread_mutex_lock(&pool->_run);
+  pthread_mutex_lock(&pool->_lock);
+  pool->_task     = task;
+  pool->_args     = (unsigned char*)args;
+  pool->_arg_size = arg_size;
+  pool->_len      = n;
+  pool->_next     = 0;
+  pool->_finished = 0;
+  pthread_cond_broadcast(&pool->_work);
+  _hll_pool_work(pool);
+  while (pool->_finished < pool->_len)
+    pthread_cond_wait(&pool->_done, &pool->_lock);
+  pthread_mutex_unlock(&pool->_lock);
+  pthread_mutex_unlock(&pool->_run);
+}
+
+// A round of hll_add_many_parallel, shared by its threads
+typedef struct {
+  hll_t *hll;
+  const hll_element_t *elements;
+  const unsigned int *lengths;
+  unsigned int len;
+  unsigned int threads;
+  // Hashes of the round, and the same hashes bucketed by range
+  hll_hash_t *hashes;
+  hll_hash_t *buckets;
+  // Start of the bucket of each range in the slice of each thread,
+  // threads + 1 per thread
+  unsigned int *offsets;
+} _hll_parallel_round_t;
+
+typedef struct {
+  _hll_parallel_round_t *round;
+  unsigned int thread;
+  unsigned long long updates;
+} _hll_parallel_task_t;
+
+// Range of the registers updated by one of [threads] threads. Ranges
+// are made of whole groups of 8 registers, so that threads do not
+// share the bytes of 6 bit registers, packed 4 in 3 bytes, nor the
+// bytes of the bitmap of changes.
+#define _HLL_PARALLEL_RANGE(idx, precision, threads) \
+  ((unsigned int)((((idx) >> 3) * (uint64_t)(threads)) >> ((precision) - 3)))
+
+// Hash a slice of the round and bucket the hashes by range
+HLL_DEF void *_hll_parallel_hash(void *arg)
+{
+  _hll_parallel_task_t *task = (_hll_parallel_task_t*)arg;
+  _hll_parallel_round_t *round = task->round;
+  const hll_t *hll = round->hll;
+  const unsigned int offset = sizeof(hll_hash_t)*8 - hll->precision;
+  const unsigned int start =
+    (unsigned int)((uint64_t)round->len * task->thread / round->threads);
+  const unsigned int end =
+    (unsigned int)((uint64_t)round->len * (task->thread + 1)
+                   / round->threads);
+  unsigned int *offsets = round->offsets + task->thread * (round->threads + 1);
+
+  for (unsigned int r = 0; r <= round->threads; ++r)
+    offsets[r] = 0;
+  for (unsigned int i = start; i < end; ++i)
+  {
+    hll_hash_t hash = _HLL_HASH(hll, round->elements[i], round->lengths[i]);
+    round->hashes[i] = hash;
+    offsets[_HLL_PARALLEL_RANGE(hash >> offset, hll->precision,
+                                round->threads) + 1]++;
+  }
+
+  offsets[0] = start;
+  for (unsigned int r = 1; r <= round->threads; ++r)
+    offsets[r] += offsets[r - 1];
+  // Fill each bucket moving its start forward, then move it back
+  for (unsigned int i = start; i < end; ++i)
+  {
+    hll_hash_t hash = round->hashes[i];
+    round->buckets[offsets[_HLL_PARALLEL_RANGE(hash >> offset,
+                                               hll->precision,
+                                               round->threads)]++] = hash;
+  }
+  for (unsigned int r = round->threads; r > 0; --r)
+    offsets[r] = offsets[r - 1];
+  offsets[0] = start;
+
+  return NULL;
+}
+
+// Update the registers of a range with its buckets from every slice
+HLL_DEF void *_hll_parallel_update(void *arg)
+{
+  _hll_parallel_task_t *task = (_hll_parallel_task_t*)arg;
+  _hll_parallel_round_t *round = task->round;
+  hll_t *hll = round->hll;
+  const unsigned int offset = sizeof(hll_hash_t)*8 - hll->precision;
+
+  unsigned long long updates = 0;
+  for (unsigned int t = 0; t < round->threads; ++t)
+  {
+    const unsigned int *offsets = round->offsets + t * (round->threads + 1);
+    for (unsigned int i = offsets[task->thread];
+         i < offsets[task->thread + 1]; ++i)
+    {
+      hll_hash_t hash = round->buckets[i];
+      unsigned int idx = (unsigned int)(hash >> offset);
+      unsigned int rank = hll_get_hash_zeros(hash, hll->precision) + 1;
+      if (rank > HLL_REGISTER_MAX)
+        rank = HLL_REGISTER_MAX;
+      if (hll->concurrent)
+      {
+        updates += _hll_register_max_atomic(hll->_registers + idx, rank);
+      } else if (rank > hll_get_register(hll, idx)) {
+        _hll_register_write(hll, idx, rank);
+        updates++;
+      }
+    }
+  }
+  task->updates = updates;
+
+  return NULL;
+}
+
+HLL_DEF hll_error hll_add_many_parallel(hll_t *hll,
+                                        const hll_element_t *elements,
+                                        const unsigned int *lengths,
+                                        size_t n,
+                                        unsigned int threads)
+{
+  if (hll == NULL || (n > 0 && (elements == NULL || lengths == NULL)))
+    return HLL_ERROR_HLL_NULL;
+
+  if (hll->representation == 0)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  hll_error err;
+  if (threads <= 1)
+  {
+    for (size_t i = 0; i < n; i += HLL_PARALLEL_CHUNK)
+    {
+      unsigned int len = (n - i < HLL_PARALLEL_CHUNK)
+        ? (unsigned int)(n - i) : HLL_PARALLEL_CHUNK;
+      if ((err = hll_add_many(hll, elements + i, lengths + i, len)) != HLL_OK)
+        return err;
+    }
+    return HLL_OK;
+  }
+  if (threads > HLL_THREADS_MAX)
+    threads = HLL_THREADS_MAX;
+
+  if (hll->representation == HLL_REPRESENTATION_SPARSE
+      && (err = _hll_sparse_to_dense(hll)) != HLL_OK)
+    return err;
+
+  const unsigned int chunk = (n < HLL_PARALLEL_CHUNK)
+    ? (unsigned int)n : HLL_PARALLEL_CHUNK;
+  _hll_parallel_round_t round = {
+    .hll     = hll,
+    .threads = threads,
+    .hashes  = HLL_CALLOC(chunk, sizeof(hll_hash_t)),
+    .buckets = HLL_CALLOC(chunk, sizeof(hll_hash_t)),
+    .offsets = HLL_CALLOC(threads * (threads + 1), sizeof(unsigned int)),
+  };
+  err = HLL_OK;
+  if (chunk > 0
+      && (round.hashes == NULL || round.buckets == NULL
+          || round.offsets == NULL))
+    err = HLL_ERROR_ALLOCATING_MEMORY;
+
+  _hll_parallel_task_t tasks[HLL_THREADS_MAX];
+  unsigned long long updates = 0;
+  for (size_t i = 0; err == HLL_OK && i < n; i += chunk)
+  {
+    round.elements = elements + i;
+    round.lengths  = lengths + i;
+    round.len      = (n - i < chunk) ? (unsigned int)(n - i) : chunk;
+    for (unsigned int t = 0; t < threads; ++t)
+      tasks[t] = (_hll_parallel_task_t){ .round = &round, .thread = t };
+    _hll_threads_run(_hll_parallel_hash, tasks, sizeof(tasks[0]), threads);
+    _hll_threads_run(_hll_parallel_update, tasks, sizeof(tasks[0]), threads);
+    for (unsigned int t = 0; t < threads; ++t)
+      updates += tasks[t].updates;
+  }
+
+  HLL_FREE(round.hashes);
+  HLL_FREE(round.buckets);
+  HLL_FREE(round.offsets);
+  if (err != HLL_OK)
+    return err;
+
+  if (hll->cached && updates > 0)
+    hll->_flags |= _HLL_FLAG_DIRTY | _HLL_FLAG_SUM_STALE;
+  _HLL_STAT_ADD(hll, inserts, n);
+  _HLL_STAT_ADD(hll, register_updates, updates);
+
+  return HLL_OK;
+}
+
+#endif // HLL_THREADS
+
+// Count the hlls in [start, end) of an array for hll_count_many
+HLL_DEF void _hll_count_range(hll_t **hlls,
+                              long long *counts,
+                              unsigned int start,
+                              unsigned int end)
+{
+  if (start + 1 < end && hlls[start + 1] != NULL)
+    HLL_PREFETCH(hlls[start + 1]);
+  for (unsigned int i = start; i < end; ++i)
+  {
+    // The header of the next hll was prefetched one step ago, so
+    // reading its registers pointer does not wait for memory
+    if (i + 2 < end && hlls[i + 2] != NULL)
+      HLL_PREFETCH(hlls[i + 2]);
+    if (i + 1 < end && hlls[i + 1] != NULL
+        && hlls[i + 1]->representation == HLL_REPRESENTATION_DENSE)
+      HLL_PREFETCH(hlls[i + 1]->_registers);
+    counts[i] = hll_count(hlls[i]);
+  }
+}
+
+#ifdef HLL_THREADS
+
+typedef struct {
+  hll_t **hlls;
+  long long *counts;
+  unsigned int start;
+  unsigned int end;
+} _hll_count_task_t;
+
+HLL_DEF void *_hll_count_task(void *arg)
+{
+  _hll_count_task_t *task = (_hll_count_task_t*)arg;
+  _hll_count_range(task->hlls, task->counts, task->start, task->end);
+  return NULL;
+}
+
+// Split the count of [n] hlls in contiguous ranges for at most
+// [threads] threads, each with at least HLL_COUNT_MANY_MIN hlls.
+// Returns the number of ranges.
+HLL_DEF unsigned int _hll_count_tasks(_hll_count_task_t *tasks,
+                                      hll_t **hlls,
+                                      unsigned int n,
+                                      long long *counts,
+                                      unsigned int threads)
+{
+  if (threads > HLL_THREADS_MAX)
+    threads = HLL_THREADS_MAX;
+  if (threads > n / HLL_COUNT_MANY_MIN)
+    threads = n / HLL_COUNT_MANY_MIN;
+  if (threads == 0)
+    threads = 1;
+
+  for (unsigned int t = 0; t < threads; ++t)
+    tasks[t] = (_hll_count_task_t){
+      .hlls   = hlls,
+      .counts = counts,
+      .start  = (unsigned int)((uint64_t)n * t / threads),
+      .end    = (unsigned int)((uint64_t)n * (t + 1) / threads),
+    };
+  return threads;
+}
+
+#endif // HLL_THREADS
+
+HLL_DEF hll_error hll_count_many(hll_t **hlls,
+                                 unsigned int n,
+                                 long long *counts,
+                                 unsigned int threads)
+{
+  if (n > 0 && (hlls == NULL || counts == NULL))
+    return HLL_ERROR_HLL_NULL;
+
+#ifdef HLL_THREADS
+  _hll_count_task_t tasks[HLL_THREADS_MAX];
+  threads = _hll_count_tasks(tasks, hlls, n, counts, threads);
+  if (threads > 1)
+  {
+    _hll_threads_run(_hll_count_task, tasks, sizeof(tasks[0]), threads);
+    return HLL_OK;
+  }
+#else
+  (void)threads;
+#endif
+
+  _hll_count_range(hlls, counts, 0, n);
+  return HLL_OK;
+}
+
+#ifdef HLL_THREADS
+
+HLL_DEF hll_error hll_count_many_pool(hll_pool_t *pool,
+                                      hll_t **hlls,
+                                      unsigned int n,
+                                      long long *counts)
+{
+  if (pool == NULL || (n > 0 && (hlls == NULL || counts == NULL)))
+    return HLL_ERROR_HLL_NULL;
+
+  if (pool->threads == 0)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  _hll_count_task_t tasks[HLL_THREADS_MAX];
+  unsigned int len = _hll_count_tasks(tasks, hlls, n, counts,
+                                      pool->threads);
+  if (len > 1)
+    _hll_pool_run(pool, _hll_count_task, tasks, sizeof(tasks[0]), len);
+  else
+    _hll_count_range(hlls, counts, 0, n);
+
+  return HLL_OK;
+}
+
+#endif // HLL_THREADS
+
+#ifdef HLL_MMAP
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+HLL_DEF hll_error _hll_store_open_impl(hll_store_t *store,
+                                       const char *path,
+                                       unsigned int precision,
+                                       unsigned int register_bits,
+                                       uint32_t slots,
+                                       uint32_t hash_id)
+{
+  if (store == NULL || path == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (precision < HLL_PRECISION_MIN || precision > HLL_PRECISION_MAX)
+    return HLL_ERROR_INVALID_PRECISION;
+  if (register_bits != 6 && register_bits != 8)
+    return HLL_ERROR_INVALID_REGISTER_BITS;
+
+  const uint32_t slot_size =
+    (HLL_REGISTERS_SIZE(precision, register_bits) + HLL_STORE_SLOT_ALIGN - 1)
+    / HLL_STORE_SLOT_ALIGN * HLL_STORE_SLOT_ALIGN;
+
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+    return HLL_ERROR_IO;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    close(fd);
+    return HLL_ERROR_IO;
+  }
+
+  unsigned char header[HLL_STORE_HEADER_SIZE] = {0};
+  uint32_t file_slots = 0;
+  if (st.st_size > 0)
+  {
+    if (st.st_size < HLL_STORE_HEADER_SIZE
+        || pread(fd, header, HLL_STORE_HEADER_SIZE, 0)
+           != HLL_STORE_HEADER_SIZE)
+    {
+      close(fd);
+      return HLL_ERROR_INVALID_FORMAT;
+    }
+
+    uint32_t file_hash_id = _HLL_READ32(header + 8);
+    file_slots = _HLL_READ32(header + 12);
+    hll_error err = HLL_OK;
+    if (header[0] != 'H' || header[1] != 'L' || header[2] != 'L'
+        || header[3] != 'S' || header[4] != HLL_STORE_VERSION)
+      err = HLL_ERROR_INVALID_FORMAT;
+    else if (header[5] != precision)
+      err = HLL_ERROR_PRECISION_MISMATCH;
+    else if (header[6] != register_bits)
+      err = HLL_ERROR_INVALID_REGISTER_BITS;
+    else if (header[7] != sizeof(hll_hash_t) * 8
+             || (hash_id != HLL_HASH_ID_UNSPECIFIED
+                 && file_hash_id != HLL_HASH_ID_UNSPECIFIED
+                 && hash_id != file_hash_id))
+      err = HLL_ERROR_HASH_MISMATCH;
+    else if (_HLL_READ32(header + 16) != slot_size
+             || HLL_STORE_HEADER_SIZE + (off_t)file_slots * slot_size
+                > st.st_size)
+      err = HLL_ERROR_INVALID_FORMAT;
+    if (err != HLL_OK)
+    {
+      close(fd);
+      return err;
+    }
+    if (file_hash_id != HLL_HASH_ID_UNSPECIFIED)
+      hash_id = file_hash_id;
+  }
+
+  if (slots < file_slots)
+    slots = file_slots;
+
+  const size_t size = HLL_STORE_HEADER_SIZE + (size_t)slots * slot_size;
+  if (slots > file_slots || st.st_size == 0)
+  {
+    // The new slots are zero filled by the file system
+    header[0] = 'H';
+    header[1] = 'L';
+    header[2] = 'L';
+    header[3] = 'S';
+    header[4] = HLL_STORE_VERSION;
+    header[5] = (unsigned char)precision;
+    header[6] = (unsigned char)register_bits;
+    header[7] = (unsigned char)(sizeof(hll_hash_t) * 8);
+    _HLL_WRITE32(header + 8, hash_id);
+    _HLL_WRITE32(header + 12, slots);
+    _HLL_WRITE32(header + 16, slot_size);
+    if (ftruncate(fd, (off_t)size) != 0
+        || pwrite(fd, header, HLL_STORE_HEADER_SIZE, 0)
+           != HLL_STORE_HEADER_SIZE)
+    {
+      close(fd);
+      return HLL_ERROR_IO;
+    }
+  }
+
+  void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED)
+  {
+    close(fd);
+    return HLL_ERROR_IO;
+  }
+
+  *store = (hll_store_t) {
+    ._base         = (unsigned char*)base,
+    ._size         = size,
+    ._fd           = fd,
+    .precision     = precision,
+    .register_bits = register_bits,
+    .hash_id       = hash_id,
+    .slots         = slots,
+    .slot_size     = slot_size,
+  };
+
+  return HLL_OK;
+}
+
+HLL_DEF hll_error _hll_store_get_impl(hll_store_t *store,
+                                      uint32_t slot,
+                                      hll_t *hll,
+                                      hll_hash_func_t hash)
+{
+  if (store == NULL || hll == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  hll->representation = 0;
+  if (store->_base == NULL)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  if (slot >= store->slots)
+    return HLL_ERROR_INVALID_SLOT;
+
+  unsigned char *registers = store->_base + HLL_STORE_HEADER_SIZE
+    + (size_t)slot * store->slot_size;
+  if (store->register_bits == 8
+      && !_hll_registers_valid(registers,
+                               HLL_REGISTERS_SIZE(store->precision, 8)))
+    return HLL_ERROR_INVALID_FORMAT;
+
+  *hll = (hll_t) {
+    ._registers     = registers,
+    .precision      = store->precision,
+    .hash           = hash,
+    .register_bits  = store->register_bits,
+    .representation = HLL_REPRESENTATION_DENSE,
+    .hash_id        = store->hash_id,
+    ._flags         = _HLL_FLAG_BORROWED,
+  };
+
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_store_sync(hll_store_t *store)
+{
+  if (store == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (store->_base == NULL)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  if (msync(store->_base, store->_size, MS_SYNC) != 0)
+    return HLL_ERROR_IO;
+
+  return HLL_OK;
+}
+
+HLL_DEF hll_error hll_store_close(hll_store_t *store)
+{
+  if (store == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  if (store->_base == NULL)
+    return HLL_ERROR_HLL_UNINITIALIZED;
+
+  hll_error err = HLL_OK;
+  if (munmap(store->_base, store->_size) != 0)
+    err = HLL_ERROR_IO;
+  if (close(store->_fd) != 0)
+    err = HLL_ERROR_IO;
+
+  *store = (hll_store_t){0};
+  store->_fd = -1;
+
+  return err;
+}
+
+HLL_DEF hll_error hll_stream_file(hll_stream_t *stream, const char *path)
+{
+  if (stream == NULL || path == NULL)
+    return HLL_ERROR_HLL_NULL;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return HLL_ERROR_IO;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    close(fd);
+    return HLL_ERROR_IO;
+  }
+
+  // Mapping an empty file fails
+  const size_t size = (size_t)st.st_size;
+  if (size == 0)
+  {
+    close(fd);
+    return HLL_OK;
+  }
+
+  void *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return HLL_ERROR_IO;
+
+  posix_madvise(base, size, POSIX_MADV_SEQUENTIAL);
+  hll_error err = hll_stream_feed(stream, base, size);
+  munmap(base, size);
+
+  return err;
+}
+
+#endif // HLL_MMAP
+
 #endif // HLL_IMPLEMENTATION
 
 //
@@ -547,6 +6457,7 @@ unsigned int integer_hash(unsigned int a, unsigned int _b)
 
 #define HLL_IMPLEMENTATION
 #define HLL_ELEMENT_T unsigned int
+#define HLL_HASH_T unsigned int
 #define HLL_HASH_FUNC integer_hash
 #include "hll.h"
 
@@ -573,11 +6484,11 @@ int main(void)
     if (unique_numbers[i])
       expected++;
 
-  int estimate = hll_count(&hll);
+  long long estimate = hll_count(&hll);
   assert(estimate >= 0);
 
   printf("Expected: %d\n", expected);
-  printf("Estimate: %d\n", estimate);
+  printf("Estimate: %lld\n", estimate);
   
   assert(hll_destroy(&hll) == HLL_OK);
   return 0;
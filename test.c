@@ -0,0 +1,1317 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+//
+// Tests of hll.h
+//
+// Run with `make test`. Every test asserts its checks and the
+// program prints "All tests passed" at the end.
+//
+
+// pread, pwrite and posix_madvise of HLL_MMAP
+#define _POSIX_C_SOURCE 200809L
+
+#define HLL_IMPLEMENTATION
+#include "hll.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HLL_THREADS
+#include <pthread.h>
+#endif
+
+// Add the decimal strings of the numbers in [from, to)
+void test_add_range(hll_t *hll, unsigned int from, unsigned int to)
+{
+  char element[16];
+  for (unsigned int i = from; i < to; ++i)
+  {
+    int len = snprintf(element, sizeof(element), "%u", i);
+    assert(hll_add(hll, element, (unsigned int)len) == HLL_OK);
+  }
+}
+
+// Serialize an hll in a buffer allocated with malloc
+unsigned char *test_serialize(hll_t *hll, size_t *len)
+{
+  assert(hll_serialize(hll, NULL, 0, len) == HLL_OK);
+  unsigned char *buffer = malloc(*len);
+  assert(buffer != NULL);
+  size_t written;
+  assert(hll_serialize(hll, buffer, *len, &written) == HLL_OK);
+  assert(written == *len);
+  return buffer;
+}
+
+// Export the delta of an hll in a buffer allocated with malloc
+unsigned char *test_export_delta(hll_t *hll, size_t *len)
+{
+  assert(hll_export_delta(hll, NULL, 0, len) == HLL_OK);
+  unsigned char *buffer = malloc(*len);
+  assert(buffer != NULL);
+  size_t written;
+  assert(hll_export_delta(hll, buffer, *len, &written) == HLL_OK);
+  assert(written == *len);
+  return buffer;
+}
+
+// Assert that two dense hlls have the same precision and registers,
+// whatever their register_bits
+void test_same_registers(const hll_t *a, const hll_t *b)
+{
+  assert(a->representation == HLL_REPRESENTATION_DENSE);
+  assert(b->representation == HLL_REPRESENTATION_DENSE);
+  assert(a->precision == b->precision);
+  for (unsigned int i = 0; i < (1u << a->precision); ++i)
+    assert(hll_get_register(a, i) == hll_get_register(b, i));
+}
+
+// Relative distance of an estimate from the exact value
+double test_error(long long estimate, long long exact)
+{
+  return (double)(estimate > exact ? estimate - exact : exact - estimate)
+    / (double)exact;
+}
+
+// Serialize and deserialize sparse and dense hlls, the copy must
+// serialize to the same bytes and have the same estimate
+void test_serialize_round_trip(void)
+{
+  const struct {
+    unsigned int representation;
+    unsigned int register_bits;
+    unsigned int elements;
+  } cases[] = {
+    { HLL_REPRESENTATION_SPARSE, 6, 100 },
+    { HLL_REPRESENTATION_DENSE,  6, 100000 },
+    { HLL_REPRESENTATION_DENSE,  8, 100000 },
+  };
+
+  for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c)
+  {
+    hll_t hll;
+    assert(hll_init(&hll,
+                    .precision = 12,
+                    .register_bits = cases[c].register_bits,
+                    .representation = cases[c].representation) == HLL_OK);
+    test_add_range(&hll, 0, cases[c].elements);
+
+    size_t len;
+    unsigned char *buffer = test_serialize(&hll, &len);
+
+    hll_t copy;
+    assert(hll_deserialize(&copy, buffer, len) == HLL_OK);
+    assert(copy.representation == hll.representation);
+    assert(copy.register_bits == hll.register_bits);
+    assert(hll_count(&copy) == hll_count(&hll));
+
+    size_t copy_len;
+    unsigned char *copy_buffer = test_serialize(&copy, &copy_len);
+    assert(copy_len == len);
+    assert(memcmp(copy_buffer, buffer, len) == 0);
+
+    free(copy_buffer);
+    free(buffer);
+    hll_destroy(&copy);
+    hll_destroy(&hll);
+  }
+}
+
+// Corrupt buffers must be rejected, and leave the hll uninitialized
+void test_deserialize_corrupt(void)
+{
+  hll_t hll;
+  assert(hll_init(&hll,
+                  .precision = 10,
+                  .register_bits = 8,
+                  .representation = HLL_REPRESENTATION_DENSE) == HLL_OK);
+  test_add_range(&hll, 0, 1000);
+
+  size_t len;
+  unsigned char *buffer = test_serialize(&hll, &len);
+  hll_t copy;
+
+  // A register bigger than HLL_REGISTER_MAX
+  buffer[HLL_SERIALIZED_HEADER_SIZE] = 200;
+  assert(hll_deserialize(&copy, buffer, len) == HLL_ERROR_INVALID_FORMAT);
+  assert(copy.representation == 0);
+  buffer[HLL_SERIALIZED_HEADER_SIZE] = 0;
+
+  // A truncated payload
+  assert(hll_deserialize(&copy, buffer, len - 1)
+         == HLL_ERROR_INVALID_FORMAT);
+
+  // A wrong magic
+  buffer[0] = 'X';
+  assert(hll_deserialize(&copy, buffer, len) == HLL_ERROR_INVALID_FORMAT);
+  assert(hll_count(&copy) == HLL_ERROR_HLL_UNINITIALIZED);
+
+  free(buffer);
+  hll_destroy(&hll);
+}
+
+// A replica kept up to date with deltas must serialize to the same
+// bytes as its source, and corrupt deltas must leave it unchanged
+void test_delta_round_trip(void)
+{
+  hll_t source, replica;
+  assert(hll_init(&source,
+                  .precision = 12,
+                  .representation = HLL_REPRESENTATION_DENSE,
+                  .track_changes = 1) == HLL_OK);
+  assert(hll_init(&replica,
+                  .precision = 12,
+                  .representation = HLL_REPRESENTATION_DENSE) == HLL_OK);
+
+  for (unsigned int round = 0; round < 3; ++round)
+  {
+    test_add_range(&source, round * 5000, (round + 1) * 5000);
+
+    size_t len;
+    unsigned char *delta = test_export_delta(&source, &len);
+    assert(hll_apply_delta(&replica, delta, len) == HLL_OK);
+    // Deltas can be applied more than once
+    assert(hll_apply_delta(&replica, delta, len) == HLL_OK);
+    free(delta);
+
+    size_t source_len, replica_len;
+    unsigned char *source_buffer  = test_serialize(&source, &source_len);
+    unsigned char *replica_buffer = test_serialize(&replica, &replica_len);
+    assert(source_len == replica_len);
+    assert(memcmp(source_buffer, replica_buffer, source_len) == 0);
+    free(replica_buffer);
+    free(source_buffer);
+  }
+
+  // Nothing changed since the last delta
+  size_t len;
+  unsigned char *delta = test_export_delta(&source, &len);
+  assert(len == HLL_DELTA_HEADER_SIZE);
+  free(delta);
+
+  test_add_range(&source, 15000, 20000);
+  delta = test_export_delta(&source, &len);
+  long long count = hll_count(&replica);
+
+  // A wrong magic, a truncated payload and a register bigger than
+  // HLL_REGISTER_MAX in the last entry
+  delta[0] = 'X';
+  assert(hll_apply_delta(&replica, delta, len) == HLL_ERROR_INVALID_FORMAT);
+  delta[0] = 'H';
+  assert(hll_apply_delta(&replica, delta, len - 1)
+         == HLL_ERROR_INVALID_FORMAT);
+  delta[len - 1] = 200;
+  assert(hll_apply_delta(&replica, delta, len) == HLL_ERROR_INVALID_FORMAT);
+  assert(hll_count(&replica) == count);
+
+  free(delta);
+  hll_destroy(&replica);
+  hll_destroy(&source);
+}
+
+// A hash function for strings other than hll_hash_string64
+hll_hash_t test_custom_hash(char *input, unsigned int input_len)
+{
+  return hll_hash_string64(input, input_len) ^ 1;
+}
+
+// Records fed to a stream in uneven chunks must be added like
+// hll_add does, and the hlls of other hash functions must be rejected
+void test_stream(void)
+{
+  const char records[] = "alpha\nbeta\ngamma\nalpha\ndelta";
+  hll_t hll, expected;
+  assert(hll_init(&hll, .precision = 10) == HLL_OK);
+  assert(hll_init(&expected, .precision = 10) == HLL_OK);
+  assert(hll_add(&expected, "alpha", 5) == HLL_OK);
+  assert(hll_add(&expected, "beta", 4) == HLL_OK);
+  assert(hll_add(&expected, "gamma", 5) == HLL_OK);
+  assert(hll_add(&expected, "delta", 5) == HLL_OK);
+
+  hll_stream_t stream;
+  assert(hll_stream_init(&stream, &hll, '\n') == HLL_OK);
+  for (size_t i = 0; i < sizeof(records) - 1; i += 7)
+  {
+    size_t len = sizeof(records) - 1 - i;
+    assert(hll_stream_feed(&stream, records + i, len < 7 ? len : 7)
+           == HLL_OK);
+  }
+  assert(hll_stream_finish(&stream) == HLL_OK);
+
+  size_t len, expected_len;
+  unsigned char *buffer          = test_serialize(&hll, &len);
+  unsigned char *expected_buffer = test_serialize(&expected, &expected_len);
+  assert(len == expected_len);
+  assert(memcmp(buffer, expected_buffer, len) == 0);
+  free(expected_buffer);
+  free(buffer);
+
+  hll.hash_id = HLL_HASH_ID_DJB2;
+  assert(hll_stream_init(&stream, &hll, '\n') == HLL_ERROR_HASH_MISMATCH);
+  assert(hll_stream_init_fixed(&stream, &hll, 4)
+         == HLL_ERROR_HASH_MISMATCH);
+
+  // A custom hash function, with an unspecified or a wrong hash_id
+  const uint32_t hash_ids[] = { HLL_HASH_ID_UNSPECIFIED, HLL_HASH_ID_XXH64 };
+  for (size_t i = 0; i < sizeof(hash_ids) / sizeof(hash_ids[0]); ++i)
+  {
+    hll_t custom;
+    assert(hll_init(&custom,
+                    .precision = 10,
+                    .hash = test_custom_hash,
+                    .hash_id = hash_ids[i]) == HLL_OK);
+    assert(hll_stream_init(&stream, &custom, '\n')
+           == HLL_ERROR_HASH_MISMATCH);
+    assert(hll_stream_init_fixed(&stream, &custom, 4)
+           == HLL_ERROR_HASH_MISMATCH);
+    hll_destroy(&custom);
+  }
+
+  hll_destroy(&expected);
+  hll_destroy(&hll);
+}
+
+#ifdef HLL_THREADS
+
+// Elements of the parallel tests, the decimal strings of [0, n)
+typedef struct {
+  char (*strings)[16];
+  hll_element_t *elements;
+  unsigned int *lengths;
+  size_t n;
+} test_elements_t;
+
+test_elements_t test_elements(size_t n)
+{
+  test_elements_t e = {
+    .strings  = malloc(n * sizeof(*e.strings)),
+    .elements = malloc(n * sizeof(*e.elements)),
+    .lengths  = malloc(n * sizeof(*e.lengths)),
+    .n        = n,
+  };
+  assert(e.strings != NULL && e.elements != NULL && e.lengths != NULL);
+  for (size_t i = 0; i < n; ++i)
+  {
+    e.lengths[i] = (unsigned int)snprintf(e.strings[i],
+                                          sizeof(e.strings[i]),
+                                          "%zu", i);
+    e.elements[i] = e.strings[i];
+  }
+  return e;
+}
+
+void test_elements_free(test_elements_t *e)
+{
+  free(e->lengths);
+  free(e->elements);
+  free(e->strings);
+}
+
+// The round buffers of hll_add_many_parallel must not be taken from
+// the allocator of the hll, an arena would keep them until a reset
+void test_add_many_parallel_arena(void)
+{
+  test_elements_t e = test_elements(100000);
+  hll_arena_t arena;
+  assert(hll_arena_init(&arena, HLL_REGISTERS_SIZE(12, 8), 4) == HLL_OK);
+
+  hll_t hll;
+  assert(hll_init(&hll,
+                  .precision = 12,
+                  .register_bits = 8,
+                  .representation = HLL_REPRESENTATION_DENSE,
+                  .allocator = &arena.allocator) == HLL_OK);
+  for (int call = 0; call < 8; ++call)
+    assert(hll_add_many_parallel(&hll, e.elements, e.lengths, e.n, 3)
+           == HLL_OK);
+  assert(arena._large == NULL);
+  assert(((_hll_arena_chunk_t*)arena._chunks)->next == NULL);
+
+  hll_destroy(&hll);
+  assert(hll_arena_release(&arena) == HLL_OK);
+  test_elements_free(&e);
+}
+
+// hll_add_many_parallel must set the registers of hll_add_many, also
+// when the threads do not divide the register groups, with 6 bit
+// registers and from a sparse hll
+void test_add_many_parallel_equal(void)
+{
+  test_elements_t e = test_elements(20000);
+  const unsigned int before = 100;
+  const unsigned int precisions[] = { 4, 9, 13 };
+  const unsigned int bits[] = { 6, 8 };
+  const unsigned int representations[] = {
+    HLL_REPRESENTATION_DENSE,
+    HLL_REPRESENTATION_SPARSE,
+  };
+  const unsigned int threads[] = { 2, 3, 5, 7 };
+  for (size_t p = 0; p < sizeof(precisions) / sizeof(precisions[0]); ++p)
+    for (size_t b = 0; b < sizeof(bits) / sizeof(bits[0]); ++b)
+      for (size_t r = 0; r < 2; ++r)
+        for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t)
+        {
+          hll_t serial, parallel;
+          assert(hll_init(&serial,
+                          .precision = precisions[p],
+                          .register_bits = bits[b],
+                          .representation = representations[r])
+                 == HLL_OK);
+          assert(hll_init(&parallel,
+                          .precision = precisions[p],
+                          .register_bits = bits[b],
+                          .representation = representations[r])
+                 == HLL_OK);
+          // A sparse hll holds a few elements before the call
+          assert(hll_add_many(&serial, e.elements, e.lengths, before)
+                 == HLL_OK);
+          assert(hll_add_many(&parallel, e.elements, e.lengths, before)
+                 == HLL_OK);
+          assert(serial.representation == parallel.representation);
+
+          assert(hll_add_many(&serial, e.elements + before,
+                              e.lengths + before, e.n - before)
+                 == HLL_OK);
+          assert(hll_add_many_parallel(&parallel, e.elements + before,
+                                       e.lengths + before, e.n - before,
+                                       threads[t]) == HLL_OK);
+          test_same_registers(&serial, &parallel);
+          assert(hll_count(&serial) == hll_count(&parallel));
+          hll_destroy(&parallel);
+          hll_destroy(&serial);
+        }
+  test_elements_free(&e);
+}
+
+#endif // HLL_THREADS
+
+// Number of chunks in a list of an arena
+unsigned int test_arena_chunks(void *list)
+{
+  unsigned int n = 0;
+  for (_hll_arena_chunk_t *chunk = list; chunk != NULL; chunk = chunk->next)
+    n++;
+  return n;
+}
+
+// Blocks of an arena are reused once freed, bigger allocations wait
+// for a reset, and a reset keeps the chunks for the next hlls
+void test_arena(void)
+{
+  hll_arena_t arena;
+  assert(hll_arena_init(NULL, 16, 0) == HLL_ERROR_HLL_NULL);
+  assert(hll_arena_init(&arena, 1, 0) == HLL_OK);
+  assert(arena.block_size == sizeof(void*));
+  assert(arena.chunk_blocks == 64);
+
+  enum { HLLS = 5 };
+  assert(hll_arena_init(&arena, HLL_REGISTERS_SIZE(10, 8), 2) == HLL_OK);
+  hll_t hlls[HLLS], expected;
+  for (unsigned int i = 0; i < HLLS; ++i)
+  {
+    assert(hll_init(&hlls[i],
+                    .precision = 10,
+                    .representation = HLL_REPRESENTATION_DENSE,
+                    .allocator = &arena.allocator) == HLL_OK);
+    test_add_range(&hlls[i], i * 1000, i * 1000 + 3000);
+  }
+  assert(test_arena_chunks(arena._chunks) == 3);
+  assert(arena._large == NULL);
+  assert(hll_init(&expected,
+                  .precision = 10,
+                  .representation = HLL_REPRESENTATION_DENSE) == HLL_OK);
+  test_add_range(&expected, 1000, 4000);
+  test_same_registers(&hlls[1], &expected);
+
+  // A freed block is zeroed and given to the next hll
+  unsigned char *registers = hlls[1]._registers;
+  hll_destroy(&hlls[1]);
+  assert(arena._free_blocks == registers);
+  assert(hll_init(&hlls[1],
+                  .precision = 10,
+                  .representation = HLL_REPRESENTATION_DENSE,
+                  .allocator = &arena.allocator) == HLL_OK);
+  assert(hlls[1]._registers == registers);
+  assert(arena._free_blocks == NULL);
+  assert(hll_count(&hlls[1]) == 0);
+  test_add_range(&hlls[1], 1000, 4000);
+  test_same_registers(&hlls[1], &expected);
+  // The neighbour block is untouched
+  hll_destroy(&expected);
+  assert(hll_init(&expected,
+                  .precision = 10,
+                  .representation = HLL_REPRESENTATION_DENSE) == HLL_OK);
+  test_add_range(&expected, 2000, 5000);
+  test_same_registers(&hlls[2], &expected);
+  assert(test_arena_chunks(arena._chunks) == 3);
+
+  // Allocations bigger than a chunk are not reused
+  hll_t large;
+  assert(hll_init(&large,
+                  .precision = 14,
+                  .representation = HLL_REPRESENTATION_DENSE,
+                  .allocator = &arena.allocator) == HLL_OK);
+  assert(test_arena_chunks(arena._large) == 1);
+  test_add_range(&large, 0, 20000);
+  hll_destroy(&large);
+  assert(test_arena_chunks(arena._large) == 1);
+  assert(arena._free_blocks == NULL);
+
+  // A sparse hll grows its list in the arena until it is dense
+  hll_t sparse;
+  assert(hll_init(&sparse,
+                  .precision = 14,
+                  .representation = HLL_REPRESENTATION_SPARSE,
+                  .allocator = &arena.allocator) == HLL_OK);
+  hll_destroy(&expected);
+  assert(hll_init(&expected,
+                  .precision = 14,
+                  .representation = HLL_REPRESENTATION_DENSE) == HLL_OK);
+  test_add_range(&sparse, 0, 20000);
+  test_add_range(&expected, 0, 20000);
+  test_same_registers(&sparse, &expected);
+  hll_destroy(&expected);
+
+  // The chunks are kept, the next hll takes the first block again
+  unsigned char *first = hlls[0]._registers;
+  assert(hll_arena_reset(&arena) == HLL_OK);
+  assert(arena._large == NULL);
+  assert(arena._free_blocks == NULL);
+  unsigned int chunks = test_arena_chunks(arena._chunks);
+  assert(hll_init(&hlls[0],
+                  .precision = 10,
+                  .representation = HLL_REPRESENTATION_DENSE,
+                  .allocator = &arena.allocator) == HLL_OK);
+  assert(hlls[0]._registers == first);
+  assert(hll_count(&hlls[0]) == 0);
+  assert(test_arena_chunks(arena._chunks) == chunks);
+
+  // The arena can be used after a release
+  assert(hll_arena_release(&arena) == HLL_OK);
+  assert(arena._chunks == NULL);
+  assert(hll_init(&hlls[0],
+                  .precision = 10,
+                  .representation = HLL_REPRESENTATION_DENSE,
+                  .allocator = &arena.allocator) == HLL_OK);
+  test_add_range(&hlls[0], 0, 3000);
+  assert(test_arena_chunks(arena._chunks) == 1);
+  assert(hll_arena_release(&arena) == HLL_OK);
+  assert(hll_arena_reset(NULL) == HLL_ERROR_HLL_NULL);
+  assert(hll_arena_release(NULL) == HLL_ERROR_HLL_NULL);
+}
+
+// Allocator of the tests, fails once [*ctx] allocations succeeded
+void *test_failing_calloc(void *ctx, size_t count, size_t size)
+{
+  unsigned int *left = ctx;
+  if (*left == 0)
+    return NULL;
+  (*left)--;
+  return calloc(count, size);
+}
+
+void test_failing_free(void *ctx, void *ptr)
+{
+  (void)ctx;
+  free(ptr);
+}
+
+// A fold that can not allocate the new registers must leave a cached
+// hll as it was
+void test_fold_allocation_failure(void)
+{
+  unsigned int left = 1;
+  hll_allocator_t allocator = {
+    .calloc = test_failing_calloc,
+    .free   = test_failing_free,
+    .ctx    = &left,
+  };
+  hll_t hll, expected;
+  assert(hll_init(&hll,
+                  .precision = 12,
+                  .representation = HLL_REPRESENTATION_DENSE,
+                  .cached = 1,
+                  .allocator = &allocator) == HLL_OK);
+  assert(hll_init(&expected,
+                  .precision = 12,
+                  .representation = HLL_REPRESENTATION_DENSE) == HLL_OK);
+  test_add_range(&hll, 0, 20000);
+  test_add_range(&expected, 0, 20000);
+  assert(hll_count(&hll) == hll_count(&expected));
+
+  assert(hll_fold(&hll, 10) == HLL_ERROR_ALLOCATING_MEMORY);
+  assert(hll.precision == 12);
+  assert(hll_count(&hll) == hll_count(&expected));
+  test_add_range(&hll, 20000, 21000);
+  test_add_range(&expected, 20000, 21000);
+  assert(hll_count(&hll) == hll_count(&expected));
+
+  left = 1;
+  assert(hll_fold(&hll, 10) == HLL_OK);
+  assert(hll_fold(&expected, 10) == HLL_OK);
+  assert(hll_count(&hll) == hll_count(&expected));
+
+  hll_destroy(&expected);
+  hll_destroy(&hll);
+}
+
+// The union of the shards must count like a single hll of all the
+// elements, and be cached until a register of a shard is raised
+void test_sharded(void)
+{
+  const unsigned int register_bits[] = { 6, 8 };
+  for (size_t b = 0; b < 2; ++b)
+  {
+    hll_sharded_t sharded;
+    hll_t expected;
+    assert(hll_sharded_init(&sharded, 3,
+                            .precision = 11,
+                            .register_bits = register_bits[b]) == HLL_OK);
+    assert(hll_init(&expected,
+                    .precision = 11,
+                    .register_bits = register_bits[b],
+                    .representation = HLL_REPRESENTATION_DENSE) == HLL_OK);
+
+    char element[16];
+    for (unsigned int i = 0; i < 30000; ++i)
+    {
+      int len = snprintf(element, sizeof(element), "%u", i);
+      assert(hll_sharded_add(&sharded, i % 3, element, (unsigned int)len)
+             == HLL_OK);
+    }
+    test_add_range(&expected, 0, 30000);
+    assert(hll_sharded_count(&sharded) == hll_count(&expected));
+
+    // Elements already in their shard raise no register
+    for (unsigned int i = 0; i < 30000; i += 3)
+    {
+      int len = snprintf(element, sizeof(element), "%u", i);
+      assert(hll_sharded_add(&sharded, 0, element, (unsigned int)len)
+             == HLL_OK);
+    }
+    for (unsigned int i = 0; i < sharded.shards; ++i)
+      assert(_HLL_SHARD(&sharded, i)->dirty == 0);
+
+    const char *more[] = { "a", "b", "c", "d", "e", "f", "g", "h" };
+    const unsigned int lengths[] = { 1, 1, 1, 1, 1, 1, 1, 1 };
+    assert(hll_sharded_add_many(&sharded, 2, (hll_element_t*)more, lengths, 8)
+           == HLL_OK);
+    assert(hll_add_many(&expected, (hll_element_t*)more, lengths, 8)
+           == HLL_OK);
+    assert(hll_sharded_count(&sharded) == hll_count(&expected));
+    assert(hll_sharded_add(&sharded, 3, "a", 1) == HLL_ERROR_INVALID_SLOT);
+
+    hll_destroy(&expected);
+    assert(hll_sharded_destroy(&sharded) == HLL_OK);
+  }
+}
+
+// At every time step, the count of a window must be the one of a
+// plain hll with the elements of that window. Elements of each step
+// overlap the ones of the previous steps.
+void test_window(void)
+{
+  enum { STEPS = 150, HORIZON = 64, ELEMENTS = 40 };
+  hll_window_t window;
+  hll_t *steps = malloc(STEPS * sizeof(*steps));
+  assert(steps != NULL);
+  assert(hll_window_init(&window, 10, HORIZON) == HLL_OK);
+
+  const uint32_t lens[] = { 1, 7, 30, HORIZON };
+  for (uint32_t t = 0; t < STEPS; ++t)
+  {
+    assert(hll_init(&steps[t],
+                    .precision = 10,
+                    .representation = HLL_REPRESENTATION_DENSE,
+                    .estimator = HLL_ESTIMATOR_HLLPP) == HLL_OK);
+    char element[16];
+    for (unsigned int i = t * 15; i < t * 15 + ELEMENTS; ++i)
+    {
+      int len = snprintf(element, sizeof(element), "%u", i);
+      assert(hll_window_add(&window, element, (unsigned int)len, t)
+             == HLL_OK);
+      assert(hll_add(&steps[t], element, (unsigned int)len) == HLL_OK);
+    }
+
+    for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); ++l)
+    {
+      hll_t expected;
+      assert(hll_init(&expected,
+                      .precision = 10,
+                      .representation = HLL_REPRESENTATION_DENSE,
+                      .estimator = HLL_ESTIMATOR_HLLPP) == HLL_OK);
+      for (uint32_t s = (t + 1 > lens[l]) ? t + 1 - lens[l] : 0;
+           s <= t; ++s)
+        assert(hll_merge(&expected, &steps[s]) == HLL_OK);
+      assert(hll_count_window(&window, lens[l]) == hll_count(&expected));
+      hll_destroy(&expected);
+    }
+  }
+  // Windows are clamped to the horizon
+  hll_t expected;
+  assert(hll_init(&expected,
+                  .precision = 10,
+                  .representation = HLL_REPRESENTATION_DENSE,
+                  .estimator = HLL_ESTIMATOR_HLLPP) == HLL_OK);
+  for (uint32_t s = STEPS - HORIZON; s < STEPS; ++s)
+    assert(hll_merge(&expected, &steps[s]) == HLL_OK);
+  assert(hll_count_window(&window, 10 * HORIZON) == hll_count(&expected));
+  hll_destroy(&expected);
+
+  for (uint32_t t = 0; t < STEPS; ++t)
+    hll_destroy(&steps[t]);
+  free(steps);
+  assert(hll_window_destroy(&window) == HLL_OK);
+}
+
+// hll_fold must give the registers of an hll with the lower precision
+// and the same elements
+void test_fold(void)
+{
+  const struct {
+    unsigned int representation;
+    unsigned int register_bits;
+    unsigned int n;
+  } cases[] = {
+    { HLL_REPRESENTATION_DENSE,  8, 50000 },
+    { HLL_REPRESENTATION_DENSE,  6, 50000 },
+    { HLL_REPRESENTATION_SPARSE, 8, 1000 },
+  };
+  const unsigned int precisions[] = { 14, 12, 10, 4 };
+  for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c)
+    for (size_t p = 0; p < sizeof(precisions) / sizeof(precisions[0]); ++p)
+    {
+      hll_t hll, expected;
+      assert(hll_init(&hll,
+                      .precision = 14,
+                      .register_bits = cases[c].register_bits,
+                      .representation = cases[c].representation)
+             == HLL_OK);
+      assert(hll_init(&expected,
+                      .precision = precisions[p],
+                      .register_bits = cases[c].register_bits,
+                      .representation = HLL_REPRESENTATION_DENSE)
+             == HLL_OK);
+      test_add_range(&hll, 0, cases[c].n);
+      test_add_range(&expected, 0, cases[c].n);
+      assert(hll.representation == cases[c].representation);
+
+      assert(hll_fold(&hll, precisions[p]) == HLL_OK);
+      assert(hll.precision == precisions[p]);
+      if (hll.representation == HLL_REPRESENTATION_SPARSE)
+        assert(_hll_sparse_to_dense(&hll) == HLL_OK);
+      test_same_registers(&hll, &expected);
+      assert(hll_count(&hll) == hll_count(&expected));
+      // The precision can not grow back
+      assert(hll_fold(&hll, 15) == HLL_ERROR_INVALID_PRECISION);
+      hll_destroy(&expected);
+      hll_destroy(&hll);
+    }
+}
+
+// Merging a source with a higher precision folds its registers, and
+// a source with a lower precision is rejected
+void test_merge_precision(void)
+{
+  const unsigned int representations[] = {
+    HLL_REPRESENTATION_DENSE,
+    HLL_REPRESENTATION_SPARSE,
+  };
+  for (size_t r = 0; r < 2; ++r)
+  {
+    hll_t dest, src, expected;
+    assert(hll_init(&dest, .precision = 10,
+                    .representation = HLL_REPRESENTATION_DENSE) == HLL_OK);
+    assert(hll_init(&src, .precision = 14,
+                    .representation = representations[r]) == HLL_OK);
+    assert(hll_init(&expected, .precision = 10,
+                    .representation = HLL_REPRESENTATION_DENSE) == HLL_OK);
+    test_add_range(&dest, 0, 3000);
+    test_add_range(&src, 2000, 2800);
+    test_add_range(&expected, 0, 3000);
+    test_add_range(&expected, 2000, 2800);
+    assert(src.representation == representations[r]);
+
+    assert(hll_merge(&dest, &src) == HLL_OK);
+    test_same_registers(&dest, &expected);
+
+    // The destination is left unchanged
+    assert(hll_merge(&src, &dest) == HLL_ERROR_PRECISION_MISMATCH);
+    assert(src.precision == 14);
+    assert(src.representation == representations[r]);
+    hll_destroy(&expected);
+    hll_destroy(&src);
+    hll_destroy(&dest);
+  }
+}
+
+// A sparse hll converted to the dense representation, by its growth
+// or explicitly, must have the registers of a dense hll with the
+// same elements
+void test_sparse_to_dense(void)
+{
+  const struct {
+    unsigned int precision;
+    unsigned int register_bits;
+  } cases[] = { { 10, 8 }, { 14, 8 }, { 14, 6 } };
+  for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c)
+  {
+    const unsigned int ns[] = { 50, 1000, 100000 };
+    for (size_t i = 0; i < sizeof(ns) / sizeof(ns[0]); ++i)
+    {
+      hll_t sparse, dense;
+      assert(hll_init(&sparse,
+                      .precision = cases[c].precision,
+                      .register_bits = cases[c].register_bits,
+                      .representation = HLL_REPRESENTATION_SPARSE)
+             == HLL_OK);
+      assert(hll_init(&dense,
+                      .precision = cases[c].precision,
+                      .register_bits = cases[c].register_bits,
+                      .representation = HLL_REPRESENTATION_DENSE)
+             == HLL_OK);
+      test_add_range(&sparse, 0, ns[i]);
+      test_add_range(&dense, 0, ns[i]);
+      if (ns[i] == 50)
+        assert(sparse.representation == HLL_REPRESENTATION_SPARSE);
+      if (ns[i] == 100000)
+        assert(sparse.representation == HLL_REPRESENTATION_DENSE);
+      if (sparse.representation == HLL_REPRESENTATION_SPARSE)
+        assert(_hll_sparse_to_dense(&sparse) == HLL_OK);
+      test_same_registers(&sparse, &dense);
+      assert(hll_count(&sparse) == hll_count(&dense));
+      hll_destroy(&dense);
+      hll_destroy(&sparse);
+    }
+  }
+}
+
+// Merge sparse and dense hlls in the four combinations, the result
+// must have the registers of a dense hll with the union
+void test_sparse_dense_merge(void)
+{
+  const unsigned int representations[] = {
+    HLL_REPRESENTATION_SPARSE,
+    HLL_REPRESENTATION_DENSE,
+  };
+  hll_t expected;
+  assert(hll_init(&expected,
+                  .precision = 14,
+                  .representation = HLL_REPRESENTATION_DENSE) == HLL_OK);
+  test_add_range(&expected, 0, 1500);
+
+  for (size_t d = 0; d < 2; ++d)
+    for (size_t s = 0; s < 2; ++s)
+    {
+      hll_t dest, src;
+      assert(hll_init(&dest, .precision = 14,
+                      .representation = representations[d]) == HLL_OK);
+      assert(hll_init(&src, .precision = 14,
+                      .representation = representations[s]) == HLL_OK);
+      test_add_range(&dest, 0, 1000);
+      test_add_range(&src, 500, 1500);
+      assert(dest.representation == representations[d]);
+      assert(src.representation == representations[s]);
+
+      assert(hll_merge(&dest, &src) == HLL_OK);
+      // Only a sparse source keeps a sparse destination sparse
+      assert(dest.representation
+             == (d == 0 && s == 0 ? HLL_REPRESENTATION_SPARSE
+                                  : HLL_REPRESENTATION_DENSE));
+      if (dest.representation == HLL_REPRESENTATION_SPARSE)
+        assert(_hll_sparse_to_dense(&dest) == HLL_OK);
+      test_same_registers(&dest, &expected);
+      hll_destroy(&src);
+      hll_destroy(&dest);
+    }
+  hll_destroy(&expected);
+}
+
+// Concurrent hlls reject the settings the atomic updates can not
+// handle, and merges into them update the registers one at a time
+void test_concurrent(void)
+{
+  hll_t hll;
+  assert(hll_init(&hll, .precision = 12, .concurrent = 1,
+                  .register_bits = 6) == HLL_ERROR_INVALID_REGISTER_BITS);
+  assert(hll_init(&hll, .precision = 12, .concurrent = 1,
+                  .representation = HLL_REPRESENTATION_SPARSE)
+         == HLL_ERROR_INVALID_REPRESENTATION);
+  assert(hll_init(&hll, .precision = 12, .concurrent = 1, .cached = 1)
+         == HLL_ERROR_UNSUPPORTED);
+  assert(hll_init(&hll, .precision = 12, .concurrent = 1) == HLL_OK);
+  assert(hll.register_bits == 8);
+  assert(hll.representation == HLL_REPRESENTATION_DENSE);
+
+  // Dense, sparse and higher precision sources
+  hll_t expected, dense, sparse, higher;
+  assert(hll_init(&expected,
+                  .precision = 12,
+                  .representation = HLL_REPRESENTATION_DENSE) == HLL_OK);
+  assert(hll_init(&dense, .precision = 12, .register_bits = 6,
+                  .representation = HLL_REPRESENTATION_DENSE) == HLL_OK);
+  assert(hll_init(&sparse, .precision = 12,
+                  .representation = HLL_REPRESENTATION_SPARSE) == HLL_OK);
+  assert(hll_init(&higher, .precision = 14,
+                  .representation = HLL_REPRESENTATION_DENSE) == HLL_OK);
+  test_add_range(&hll, 0, 1000);
+  test_add_range(&dense, 500, 20000);
+  test_add_range(&sparse, 30000, 30100);
+  test_add_range(&higher, 40000, 60000);
+  assert(sparse.representation == HLL_REPRESENTATION_SPARSE);
+  test_add_range(&expected, 0, 20000);
+  test_add_range(&expected, 30000, 30100);
+  test_add_range(&expected, 40000, 60000);
+
+  assert(hll_merge(&hll, &dense) == HLL_OK);
+  assert(hll_merge(&hll, &sparse) == HLL_OK);
+  assert(hll_merge(&hll, &higher) == HLL_OK);
+  test_same_registers(&hll, &expected);
+  assert(hll_count(&hll) == hll_count(&expected));
+
+  hll_destroy(&higher);
+  hll_destroy(&sparse);
+  hll_destroy(&dense);
+  hll_destroy(&expected);
+  hll_destroy(&hll);
+}
+
+#ifdef HLL_THREADS
+
+// Thread of test_sharded_threads, adds its slice to its shard
+typedef struct {
+  hll_sharded_t *sharded;
+  unsigned int shard;
+  unsigned int threads;
+  unsigned int n;
+} test_sharded_task_t;
+
+void *test_sharded_task(void *arg)
+{
+  test_sharded_task_t *task = arg;
+  char element[16];
+  for (unsigned int i = task->shard; i < task->n; i += task->threads)
+  {
+    int len = snprintf(element, sizeof(element), "%u", i);
+    assert(hll_sharded_add(task->sharded, task->shard, element,
+                           (unsigned int)len) == HLL_OK);
+  }
+  return NULL;
+}
+
+// Threads adding to their own shard, counted after the join
+void test_sharded_threads(void)
+{
+  enum { THREADS = 4 };
+  hll_sharded_t sharded;
+  hll_t expected;
+  assert(hll_sharded_init(&sharded, THREADS, .precision = 12) == HLL_OK);
+  assert(hll_init(&expected,
+                  .precision = 12,
+                  .representation = HLL_REPRESENTATION_DENSE) == HLL_OK);
+
+  for (unsigned int round = 1; round <= 2; ++round)
+  {
+    pthread_t threads[THREADS];
+    test_sharded_task_t tasks[THREADS];
+    for (unsigned int t = 0; t < THREADS; ++t)
+    {
+      tasks[t] = (test_sharded_task_t){
+        .sharded = &sharded,
+        .shard   = t,
+        .threads = THREADS,
+        .n       = round * 50000,
+      };
+      assert(pthread_create(&threads[t], NULL, test_sharded_task,
+                            &tasks[t]) == 0);
+    }
+    for (unsigned int t = 0; t < THREADS; ++t)
+      assert(pthread_join(threads[t], NULL) == 0);
+
+    test_add_range(&expected, 0, round * 50000);
+    assert(hll_sharded_count(&sharded) == hll_count(&expected));
+  }
+
+  hll_destroy(&expected);
+  assert(hll_sharded_destroy(&sharded) == HLL_OK);
+}
+
+// hll_count_many, with and without a pool, must give the counts of
+// hll_count whatever the number of threads
+void test_count_many(void)
+{
+  enum { HLLS = 5 * HLL_COUNT_MANY_MIN + 7 };
+  hll_t *hlls = malloc(HLLS * sizeof(*hlls));
+  hll_t **pointers = malloc(HLLS * sizeof(*pointers));
+  long long *expected = malloc(HLLS * sizeof(*expected));
+  long long *counts = malloc(HLLS * sizeof(*counts));
+  assert(hlls != NULL && pointers != NULL);
+  assert(expected != NULL && counts != NULL);
+  for (unsigned int i = 0; i < HLLS; ++i)
+  {
+    assert(hll_init(&hlls[i],
+                    .precision = 4 + i % 7,
+                    .representation = (i % 3 == 0)
+                      ? HLL_REPRESENTATION_SPARSE
+                      : HLL_REPRESENTATION_DENSE) == HLL_OK);
+    test_add_range(&hlls[i], i, i + (i * 7) % 500);
+    pointers[i] = &hlls[i];
+  }
+  // An error is counted like any hll
+  pointers[HLLS / 2] = NULL;
+  for (unsigned int i = 0; i < HLLS; ++i)
+    expected[i] = hll_count(pointers[i]);
+
+  const unsigned int lengths[] = { 0, 1, HLL_COUNT_MANY_MIN, HLLS };
+  const unsigned int threads[] = { 0, 1, 2, 3, 5, HLL_THREADS_MAX + 1 };
+  for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); ++l)
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t)
+    {
+      memset(counts, 0, HLLS * sizeof(*counts));
+      assert(hll_count_many(pointers, lengths[l], counts, threads[t])
+             == HLL_OK);
+      assert(memcmp(counts, expected, lengths[l] * sizeof(*counts)) == 0);
+    }
+
+  // The threads of a pool are reused by every call
+  const unsigned int pool_threads[] = { 1, 4 };
+  for (size_t p = 0; p < 2; ++p)
+  {
+    hll_pool_t pool;
+    assert(hll_pool_init(&pool, pool_threads[p]) == HLL_OK);
+    assert(pool.threads == pool_threads[p]);
+    for (int call = 0; call < 20; ++call)
+    {
+      unsigned int n = lengths[call % 4];
+      memset(counts, 0, HLLS * sizeof(*counts));
+      assert(hll_count_many_pool(&pool, pointers, n, counts) == HLL_OK);
+      assert(memcmp(counts, expected, n * sizeof(*counts)) == 0);
+    }
+    assert(hll_pool_destroy(&pool) == HLL_OK);
+    assert(hll_count_many_pool(&pool, pointers, 1, counts)
+           == HLL_ERROR_HLL_UNINITIALIZED);
+  }
+
+  for (unsigned int i = 0; i < HLLS; ++i)
+    hll_destroy(&hlls[i]);
+  free(counts);
+  free(expected);
+  free(pointers);
+  free(hlls);
+}
+
+// Thread of test_concurrent_threads, adds the numbers in [from, to)
+// or merges [src] into [hll]
+typedef struct {
+  hll_t *hll;
+  hll_t *src;
+  unsigned int from;
+  unsigned int to;
+} test_concurrent_task_t;
+
+void *test_concurrent_task(void *arg)
+{
+  test_concurrent_task_t *task = arg;
+  if (task->src != NULL)
+    assert(hll_merge(task->hll, task->src) == HLL_OK);
+  else
+    test_add_range(task->hll, task->from, task->to);
+  return NULL;
+}
+
+// Threads adding overlapping ranges and merging into a concurrent
+// hll must give the registers of a serial insertion
+void test_concurrent_threads(void)
+{
+  enum { THREADS = 4 };
+  hll_t hll, src, expected;
+  assert(hll_init(&hll, .precision = 12, .concurrent = 1) == HLL_OK);
+  assert(hll_init(&src,
+                  .precision = 12,
+                  .representation = HLL_REPRESENTATION_DENSE) == HLL_OK);
+  assert(hll_init(&expected,
+                  .precision = 12,
+                  .representation = HLL_REPRESENTATION_DENSE) == HLL_OK);
+  test_add_range(&src, 100000, 150000);
+
+  pthread_t threads[THREADS + 1];
+  test_concurrent_task_t tasks[THREADS + 1];
+  for (unsigned int t = 0; t < THREADS; ++t)
+    tasks[t] = (test_concurrent_task_t){
+      .hll  = &hll,
+      .from = t * 10000,
+      .to   = t * 10000 + 20000,
+    };
+  tasks[THREADS] = (test_concurrent_task_t){ .hll = &hll, .src = &src };
+  for (unsigned int t = 0; t <= THREADS; ++t)
+    assert(pthread_create(&threads[t], NULL, test_concurrent_task,
+                          &tasks[t]) == 0);
+  for (unsigned int t = 0; t <= THREADS; ++t)
+    assert(pthread_join(threads[t], NULL) == 0);
+
+  test_add_range(&expected, 0, (THREADS + 1) * 10000);
+  test_add_range(&expected, 100000, 150000);
+  test_same_registers(&hll, &expected);
+  assert(hll_count(&hll) == hll_count(&expected));
+
+  hll_destroy(&expected);
+  hll_destroy(&src);
+  hll_destroy(&hll);
+}
+
+#endif // HLL_THREADS
+
+#ifdef HLL_MMAP
+
+#define TEST_STORE_PATH "hll_test.store"
+
+// Overwrite [len] bytes of the store file at [offset]
+void test_store_write(long offset, const void *bytes, size_t len)
+{
+  FILE *file = fopen(TEST_STORE_PATH, "r+b");
+  assert(file != NULL);
+  assert(fseek(file, offset, SEEK_SET) == 0);
+  assert(fwrite(bytes, 1, len, file) == len);
+  assert(fclose(file) == 0);
+}
+
+// Open, grow and reopen a store, and reject mismatched settings and
+// corrupt files
+void test_store(void)
+{
+  remove(TEST_STORE_PATH);
+  hll_store_t store;
+  hll_t hll, expected;
+  assert(hll_init(&expected,
+                  .precision = 10,
+                  .representation = HLL_REPRESENTATION_DENSE) == HLL_OK);
+  test_add_range(&expected, 0, 5000);
+
+  // A new store starts with empty slots
+  assert(hll_store_open(&store, TEST_STORE_PATH, 10, 8, 4) == HLL_OK);
+  assert(store.slots == 4);
+  assert(store.slot_size == HLL_REGISTERS_SIZE(10, 8));
+  assert(hll_store_get(&store, 4, &hll) == HLL_ERROR_INVALID_SLOT);
+  assert(hll_store_get(&store, 3, &hll) == HLL_OK);
+  assert(hll_count(&hll) == 0);
+  test_add_range(&hll, 0, 5000);
+  assert(hll_count(&hll) == hll_count(&expected));
+  assert(hll_store_sync(&store) == HLL_OK);
+  assert(hll_store_close(&store) == HLL_OK);
+  assert(hll_store_close(&store) == HLL_ERROR_HLL_UNINITIALIZED);
+
+  // Fewer slots keep the ones of the file, more slots grow it
+  assert(hll_store_open(&store, TEST_STORE_PATH, 10, 8, 2) == HLL_OK);
+  assert(store.slots == 4);
+  assert(hll_store_close(&store) == HLL_OK);
+  assert(hll_store_open(&store, TEST_STORE_PATH, 10, 8, 9) == HLL_OK);
+  assert(store.slots == 9);
+  assert(hll_store_get(&store, 3, &hll) == HLL_OK);
+  test_same_registers(&hll, &expected);
+  assert(hll_store_get(&store, 8, &hll) == HLL_OK);
+  assert(hll_count(&hll) == 0);
+  assert(hll_store_close(&store) == HLL_OK);
+
+  // The settings must match the ones of the file
+  assert(hll_store_open(&store, TEST_STORE_PATH, 12, 8, 4)
+         == HLL_ERROR_PRECISION_MISMATCH);
+  assert(hll_store_open(&store, TEST_STORE_PATH, 10, 6, 4)
+         == HLL_ERROR_INVALID_REGISTER_BITS);
+  assert(_hll_store_open_impl(&store, TEST_STORE_PATH, 10, 8, 4,
+                              HLL_HASH_ID_DJB2)
+         == HLL_ERROR_HASH_MISMATCH);
+
+  // A register above HLL_REGISTER_MAX only rejects its slot
+  const unsigned char corrupt = HLL_REGISTER_MAX + 1;
+  test_store_write(HLL_STORE_HEADER_SIZE + 2 * HLL_REGISTERS_SIZE(10, 8)
+                   + 5, &corrupt, 1);
+  assert(hll_store_open(&store, TEST_STORE_PATH, 10, 8, 4) == HLL_OK);
+  assert(hll_store_get(&store, 2, &hll) == HLL_ERROR_INVALID_FORMAT);
+  assert(hll.representation == 0);
+  assert(hll_store_get(&store, 3, &hll) == HLL_OK);
+  test_same_registers(&hll, &expected);
+  assert(hll_store_close(&store) == HLL_OK);
+
+  // A header claiming more slots than the file holds
+  unsigned char slots[4] = { 0xFF, 0xFF, 0, 0 };
+  test_store_write(12, slots, sizeof(slots));
+  assert(hll_store_open(&store, TEST_STORE_PATH, 10, 8, 4)
+         == HLL_ERROR_INVALID_FORMAT);
+  test_store_write(0, "HLLX", 4);
+  assert(hll_store_open(&store, TEST_STORE_PATH, 10, 8, 4)
+         == HLL_ERROR_INVALID_FORMAT);
+
+  hll_destroy(&expected);
+  assert(remove(TEST_STORE_PATH) == 0);
+}
+
+#endif // HLL_MMAP
+
+// In the range of the bias correction, from 0.5 m to 5 m elements,
+// the relative error of each estimator must stay below three
+// standard errors 1.04 / sqrt(m)
+void test_estimate_error(void)
+{
+  const unsigned int precisions[] = { 10, 14 };
+  const unsigned int estimators[] = {
+    HLL_ESTIMATOR_HLLPP,
+    HLL_ESTIMATOR_ERTL,
+  };
+  const double points[] = { 0.5, 1, 2, 2.5, 3, 4, 5 };
+  for (size_t p = 0; p < 2; ++p)
+    for (size_t e = 0; e < 2; ++e)
+      for (unsigned int run = 0; run < 4; ++run)
+      {
+        const unsigned int m = 1u << precisions[p];
+        const double bound = 3 * 1.04 / sqrt((double)m);
+        const unsigned int offset = run * 10000000;
+        hll_t hll;
+        assert(hll_init(&hll,
+                        .precision = precisions[p],
+                        .representation = HLL_REPRESENTATION_DENSE,
+                        .estimator = estimators[e]) == HLL_OK);
+        unsigned int n = 0;
+        for (size_t i = 0; i < sizeof(points) / sizeof(points[0]); ++i)
+        {
+          unsigned int next = (unsigned int)(points[i] * m);
+          test_add_range(&hll, offset + n, offset + next);
+          n = next;
+          assert(test_error(hll_count(&hll), n) < bound);
+        }
+        hll_destroy(&hll);
+      }
+}
+
+// Highest register of a dense hll
+unsigned int test_max_register(const hll_t *hll)
+{
+  unsigned int max = 0;
+  for (unsigned int i = 0; i < (1u << hll->precision); ++i)
+    if (hll_get_register(hll, i) > max)
+      max = hll_get_register(hll, i);
+  return max;
+}
+
+// hll_count_union must give the count of the merged hlls, for dense
+// hlls read in blocks and for the ones merged in a temporary hll
+void test_count_union(void)
+{
+  const struct {
+    unsigned int precision;
+    unsigned int register_bits;
+    unsigned int representation;
+  } sets[][3] = {
+    // Same precision, read in blocks
+    { { 12, 8, HLL_REPRESENTATION_DENSE },
+      { 12, 8, HLL_REPRESENTATION_DENSE },
+      { 12, 8, HLL_REPRESENTATION_DENSE } },
+    { { 12, 8, HLL_REPRESENTATION_DENSE },
+      { 12, 6, HLL_REPRESENTATION_DENSE },
+      { 12, 8, HLL_REPRESENTATION_DENSE } },
+    // Different precisions and a sparse hll, merged
+    { { 14, 8, HLL_REPRESENTATION_DENSE },
+      { 12, 6, HLL_REPRESENTATION_DENSE },
+      { 14, 8, HLL_REPRESENTATION_SPARSE } },
+  };
+  const unsigned int estimators[] = {
+    HLL_ESTIMATOR_HLLPP,
+    HLL_ESTIMATOR_ERTL,
+  };
+  for (size_t c = 0; c < sizeof(sets) / sizeof(sets[0]); ++c)
+    for (size_t e = 0; e < 2; ++e)
+    {
+      hll_t hlls[3], merged;
+      hll_t *pointers[3];
+      for (unsigned int i = 0; i < 3; ++i)
+      {
+        assert(hll_init(&hlls[i],
+                        .precision = sets[c][i].precision,
+                        .register_bits = sets[c][i].register_bits,
+                        .representation = sets[c][i].representation,
+                        .estimator = estimators[e]) == HLL_OK);
+        pointers[i] = &hlls[i];
+      }
+      test_add_range(&hlls[0], 0, 20000);
+      test_add_range(&hlls[1], 10000, 25000);
+      test_add_range(&hlls[2], 24000, 24500);
+      assert(hlls[2].representation == sets[c][2].representation);
+
+      assert(hll_init(&merged,
+                      .precision = 12,
+                      .representation = HLL_REPRESENTATION_DENSE,
+                      .estimator = estimators[e]) == HLL_OK);
+      for (unsigned int i = 0; i < 3; ++i)
+        assert(hll_merge(&merged, &hlls[i]) == HLL_OK);
+      // The single precision sum of hll_count is exact
+      assert(test_max_register(&merged) <= 16);
+      assert(hll_count_union(pointers, 3) == hll_count(&merged));
+      assert(hll_count_union(pointers, 1) == hll_count(&hlls[0]));
+
+      hll_destroy(&merged);
+      for (unsigned int i = 0; i < 3; ++i)
+        hll_destroy(&hlls[i]);
+    }
+  assert(hll_count_union(NULL, 0) == 0);
+}
+
+// Joint estimate of A = [0, 60000) and B = [40000, 100000)
+void test_count_joint(void)
+{
+  hll_t hll_a, hll_b;
+  assert(hll_init(&hll_a, .precision = 14) == HLL_OK);
+  assert(hll_init(&hll_b, .precision = 14) == HLL_OK);
+  test_add_range(&hll_a, 0, 60000);
+  test_add_range(&hll_b, 40000, 100000);
+
+  hll_joint_t joint;
+  assert(hll_count_joint(&hll_a, &hll_b, &joint) == HLL_OK);
+  assert(test_error(joint.a_only, 40000) < 0.05);
+  assert(test_error(joint.b_only, 40000) < 0.05);
+  assert(test_error(joint.intersection, 20000) < 0.1);
+  assert(test_error(joint.total, 100000) < 0.05);
+  assert(joint.jaccard > 0.18 && joint.jaccard < 0.22);
+  assert(hll_count_intersection(&hll_a, &hll_b) == joint.intersection);
+
+  hll_destroy(&hll_b);
+  hll_destroy(&hll_a);
+}
+
+int main(void)
+{
+  test_serialize_round_trip();
+  test_deserialize_corrupt();
+  test_delta_round_trip();
+  test_stream();
+  test_window();
+  test_arena();
+  test_fold();
+  test_fold_allocation_failure();
+  test_merge_precision();
+  test_sharded();
+  test_sparse_to_dense();
+  test_sparse_dense_merge();
+  test_concurrent();
+#ifdef HLL_THREADS
+  test_sharded_threads();
+  test_concurrent_threads();
+  test_count_many();
+#endif
+  test_estimate_error();
+  test_count_union();
+  test_count_joint();
+#ifdef HLL_MMAP
+  test_store();
+#endif
+#ifdef HLL_THREADS
+  test_add_many_parallel_arena();
+  test_add_many_parallel_equal();
+#endif
+
+  printf("All tests passed\n");
+  return 0;
+}